@@ -0,0 +1,320 @@
+#include <iostream>
+#include <pqxx/pqxx>
+#include "batched.h"
+#include "database_queries.h"
+#include "snapshot.h"
+#include "calendar.h"
+#include <string>
+#include <vector>
+#include <variant>
+#include <set>
+#include <map>
+
+// Function to collect stop ids of the candidate stops for binding to "= ANY($n)"
+std::vector<std::string> stop_ids(const std::vector<BusStop> &stops) {
+    std::vector<std::string> ids;
+    ids.reserve(stops.size());
+    for (const auto &stop : stops) {
+        ids.push_back(stop.id);
+    }
+    return ids;
+}
+
+// Function to map stop ids to their names
+std::map<std::string, std::string> stop_names(const std::vector<BusStop> &stops) {
+    std::map<std::string, std::string> names;
+    for (const auto &stop : stops) {
+        names.emplace(stop.id, stop.name);
+    }
+    return names;
+}
+
+// Direct connections for all candidate start stops in a single round-trip.
+// The database keeps only forward (start before goal) pairs ending at a candidate
+// goal stop and returns the earliest departure per line and direction.
+std::vector<Solution> find_route_without_changing_bus_batched(pqxx::connection &conn, const QueryContext &context) {
+    std::vector<Solution> solutions;
+    const std::string &time = context.time;
+    const std::string &day_type = context.day_type;
+    const std::vector<BusStop> &nearest_start_stops = context.start_stops;
+    const std::vector<BusStop> &nearest_goal_stops = context.goal_stops;
+    std::map<std::string, std::string> start_names = stop_names(nearest_start_stops);
+    std::map<std::string, std::string> goal_names = stop_names(nearest_goal_stops);
+
+    pqxx::work txn(conn);
+    std::string query = "SELECT DISTINCT ON (bl.name, bl.direction) "
+                        "bl.name, bl.direction, bd1.time AS departure_time, bd2.time AS arrival_time, "
+                        "bd1.bus_stop_id AS start_stop_id, bd2.bus_stop_id AS goal_stop_id "
+                        "FROM route_search_busline bl "
+                        "JOIN route_search_busdeparture bd1 ON bl.id = bd1.bus_line_id "
+                        "JOIN route_search_busdeparture bd2 ON bl.id = bd2.bus_line_id "
+                        "AND bd1.departure_ordinal_number = bd2.departure_ordinal_number "
+                        "AND bd1.route_day = bd2.route_day "
+                        "JOIN route_search_busstopinbusline bs1 ON bl.id = bs1.bus_line_id AND bd1.bus_stop_id = bs1.bus_stop_id "
+                        "JOIN route_search_busstopinbusline bs2 ON bl.id = bs2.bus_line_id AND bd2.bus_stop_id = bs2.bus_stop_id "
+                        "WHERE bd1.bus_stop_id = ANY($1) "
+                        "AND bd2.bus_stop_id = ANY($2) "
+                        "AND bd1.time >= $3 "
+                        "AND bd1.route_day = $4 "
+                        "AND bs1.ordinal_number < bs2.ordinal_number "
+                        "ORDER BY bl.name, bl.direction, bd1.time";
+    pqxx::result result = exec_params_timed(txn, query, to_pg_array(stop_ids(nearest_start_stops)), to_pg_array(stop_ids(nearest_goal_stops)), time, day_type);
+    txn.commit();
+
+    for (auto row : result) {
+        Solution sol;
+        sol.bus_line = row["name"].c_str();
+        sol.direction = row["direction"].c_str();
+        sol.departure_time = row["departure_time"].c_str();
+        sol.arrival_time = row["arrival_time"].c_str();
+        sol.start_stop = start_names[row["start_stop_id"].c_str()];
+        sol.goal_stop = goal_names[row["goal_stop_id"].c_str()];
+        solutions.push_back(sol);
+    }
+
+    return solutions;
+}
+
+// Function to collect stop ids of the candidate stops as the snapshot stores them
+std::vector<int32_t> numeric_stop_ids(const std::vector<BusStop> &stops) {
+    std::vector<int32_t> ids;
+    ids.reserve(stops.size());
+    for (const auto &stop : stops) {
+        ids.push_back(std::stoi(stop.id));
+    }
+    return ids;
+}
+
+// Function to collect the lines running the given patterns
+std::set<int32_t> pattern_lines(const DayPartition &partition, const DenseBitset &patterns) {
+    std::set<int32_t> lines;
+    for (uint32_t pattern : patterns.to_indices()) {
+        lines.insert(partition.patterns[pattern]->line_id);
+    }
+    return lines;
+}
+
+// Second-leg queries worth sending in the one-change phase. The snapshot's stop -> pattern
+// bitsets give the lines through a start stop and the lines through a goal stop on the
+// query's day, and transfers(A, B) of the transfer table the stops where line A of the
+// first kind can be left for line B of the second. Both are supersets, so the queries left
+// out or restricted would not have found anything more.
+struct TransferPruning {
+    // (first line id, transfer stop id) -> ids of the goal lines to change to there
+    std::map<std::pair<int32_t, int32_t>, std::vector<std::string>> change_lines;
+};
+
+TransferPruning transfer_pruning(const TimetableSnapshot &snapshot, const QueryContext &context) {
+    const DayPartition &partition = snapshot.partition(day_type_for_date(context.date));
+    TransferCandidates candidates = find_transfer_candidates(partition, numeric_stop_ids(context.start_stops), numeric_stop_ids(context.goal_stops));
+    std::set<int32_t> goal_lines = pattern_lines(partition, candidates.goal_patterns);
+
+    TransferPruning pruning;
+    for (int32_t first_line : pattern_lines(partition, candidates.origin_patterns)) {
+        for (const LinePairTransfers &pair : snapshot.transfers->pairs_from(first_line)) {
+            if (goal_lines.find(pair.to_line) == goal_lines.end()) {
+                continue;
+            }
+            for (const TransferPoint &point : snapshot.transfers->transfers(first_line, pair.to_line)) {
+                pruning.change_lines[{first_line, point.stop_id}].push_back(std::to_string(pair.to_line));
+            }
+        }
+    }
+    return pruning;
+}
+
+// First leg of a one-change connection waiting for its second-leg query
+struct FirstLeg {
+    std::string bus_line;
+    std::string direction;
+    std::string departure_time;
+    std::string arrival_time;
+    std::string start_stop;
+    std::string second_stop_id;
+    std::string second_stop;
+};
+
+// Function to collect the used bus lines for binding to "<> ALL($n)"
+std::vector<std::string> bus_line_names(const std::set<std::string> &bus_lines) {
+    return std::vector<std::string>(bus_lines.begin(), bus_lines.end());
+}
+
+// One-change connections with the pruning done by the database.
+// The first query returns, for every line leaving a candidate start stop, the earliest
+// arrival at each stop further along that line. Every such stop that is not a goal stop
+// is a transfer point, and its second-leg query only returns forward pairs ending at a
+// goal stop, earliest departure per line and direction. The second-leg queries are
+// pipelined on the same connection instead of waiting for each answer in turn.
+// With a snapshot in the context only the transfers of transfer_pruning are expanded, each
+// to its own goal lines. The first query is left whole, as every line in it is excluded
+// from the second leg.
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_route_with_changing_bus_batched(pqxx::connection &conn, const QueryContext &context, const std::set<std::string> &used_buses) {
+    std::vector<std::variant<Solution, SolutionTwoBuses>> solutions;
+    std::map<std::pair<std::string, std::string>, SolutionTwoBuses> earliest_solutions;
+    const std::string &time = context.time;
+    const std::string &day_type = context.day_type;
+    const std::vector<BusStop> &nearest_start_stops = context.start_stops;
+    const std::vector<BusStop> &nearest_goal_stops = context.goal_stops;
+    std::map<std::string, std::string> start_names = stop_names(nearest_start_stops);
+    std::map<std::string, std::string> goal_names = stop_names(nearest_goal_stops);
+    std::string goal_stop_array = to_pg_array(stop_ids(nearest_goal_stops));
+    std::string used_bus_array = to_pg_array(bus_line_names(used_buses));
+
+    pqxx::work txn(conn);
+    std::string query_first_bus = "SELECT DISTINCT ON (bl.name, bl.direction, bd2.bus_stop_id) "
+                                  "bl.id AS line_id, bl.name, bl.direction, bd1.time AS departure_time, bd2.time AS arrival_time, "
+                                  "bd1.bus_stop_id AS start_stop_id, bd2.bus_stop_id AS second_stop_id, bs.name AS second_stop_name "
+                                  "FROM route_search_busline bl "
+                                  "JOIN route_search_busdeparture bd1 ON bl.id = bd1.bus_line_id "
+                                  "JOIN route_search_busdeparture bd2 ON bl.id = bd2.bus_line_id "
+                                  "AND bd1.departure_ordinal_number = bd2.departure_ordinal_number "
+                                  "AND bd1.route_day = bd2.route_day "
+                                  "JOIN route_search_busstopinbusline bs1 ON bl.id = bs1.bus_line_id AND bd1.bus_stop_id = bs1.bus_stop_id "
+                                  "JOIN route_search_busstopinbusline bs2 ON bl.id = bs2.bus_line_id AND bd2.bus_stop_id = bs2.bus_stop_id "
+                                  "JOIN route_search_busstop bs ON bs.id = bd2.bus_stop_id "
+                                  "WHERE bd1.bus_stop_id = ANY($1) "
+                                  "AND bd1.time >= $2 "
+                                  "AND bd1.route_day = $3 "
+                                  "AND bl.name <> ALL($4) "
+                                  "AND bs1.ordinal_number < bs2.ordinal_number "
+                                  "ORDER BY bl.name, bl.direction, bd2.bus_stop_id, bd2.time, bd1.time DESC";
+    pqxx::result result = exec_params_timed(txn, query_first_bus, to_pg_array(stop_ids(nearest_start_stops)), time, day_type, used_bus_array);
+
+    std::set<std::pair<std::string, std::string>> first_bus_list;
+    for (auto row : result) {
+        first_bus_list.insert({row["name"].c_str(), row["direction"].c_str()});
+    }
+
+    // Second-leg queries are independent of each other, so they are all queued on one
+    // pipeline and their results consumed in whatever order they come back. The pipeline
+    // has to be closed before the transaction commits, hence the extra scope.
+    std::map<pqxx::pipeline::query_id, FirstLeg> pending_first_legs;
+    // Without a snapshot every stop after a start stop is tried as a transfer, to every line
+    TransferPruning pruning;
+    if (context.snapshot) {
+        pruning = transfer_pruning(*context.snapshot, context);
+    }
+    {
+        pqxx::pipeline pipe(txn);
+
+        for (auto row : result) {
+            FirstLeg first_leg;
+            first_leg.bus_line = row["name"].c_str();
+            first_leg.direction = row["direction"].c_str();
+            first_leg.departure_time = row["departure_time"].c_str();
+            first_leg.arrival_time = row["arrival_time"].c_str();
+            first_leg.start_stop = start_names[row["start_stop_id"].c_str()];
+            first_leg.second_stop_id = row["second_stop_id"].c_str();
+            first_leg.second_stop = row["second_stop_name"].c_str();
+
+            auto goal_stop = goal_names.find(first_leg.second_stop_id);
+            if (goal_stop != goal_names.end()) {
+                SolutionTwoBuses solTwoBuses;
+                solTwoBuses.bus_line = first_leg.bus_line;
+                solTwoBuses.direction = first_leg.direction;
+                solTwoBuses.departure_time = first_leg.departure_time;
+                solTwoBuses.arrival_time = first_leg.arrival_time;
+                solTwoBuses.start_stop = first_leg.start_stop;
+                solTwoBuses.goal_stop = goal_stop->second;
+
+                auto key = std::make_pair(first_leg.bus_line, first_leg.direction);
+                if (earliest_solutions.find(key) == earliest_solutions.end() || solTwoBuses.departure_time < earliest_solutions[key].departure_time) {
+                    earliest_solutions[key] = solTwoBuses;
+                }
+                continue;
+            }
+            std::string change_line_filter;
+            if (context.snapshot) {
+                auto change_lines = pruning.change_lines.find({row["line_id"].as<int32_t>(), std::stoi(first_leg.second_stop_id)});
+                if (change_lines == pruning.change_lines.end()) {
+                    continue;
+                }
+                change_line_filter = "AND bl.id = ANY(" + txn.quote(to_pg_array(change_lines->second)) + ") ";
+            }
+
+            std::string query_second_bus = "SELECT DISTINCT ON (bl.name, bl.direction) "
+                                           "bl.name, bl.direction, bd1.time AS departure_time, bd2.time AS arrival_time, bd2.bus_stop_id AS goal_stop_id "
+                                           "FROM route_search_busline bl "
+                                           "JOIN route_search_busdeparture bd1 ON bl.id = bd1.bus_line_id "
+                                           "JOIN route_search_busdeparture bd2 ON bl.id = bd2.bus_line_id "
+                                           "AND bd1.departure_ordinal_number = bd2.departure_ordinal_number "
+                                           "AND bd1.route_day = bd2.route_day "
+                                           "JOIN route_search_busstopinbusline bs1 ON bl.id = bs1.bus_line_id AND bd1.bus_stop_id = bs1.bus_stop_id "
+                                           "JOIN route_search_busstopinbusline bs2 ON bl.id = bs2.bus_line_id AND bd2.bus_stop_id = bs2.bus_stop_id "
+                                           "WHERE bd1.bus_stop_id = " + txn.quote(first_leg.second_stop_id) + " "
+                                           "AND bl.name <> " + txn.quote(first_leg.bus_line) + " "
+                                           "AND bd1.time >= " + txn.quote(first_leg.arrival_time) + " "
+                                           "AND bd1.route_day = " + txn.quote(day_type) + " "
+                                           "AND bd2.bus_stop_id = ANY(" + txn.quote(goal_stop_array) + ") "
+                                           "AND bl.name <> ALL(" + txn.quote(used_bus_array) + ") " +
+                                           change_line_filter +
+                                           "AND bs1.ordinal_number < bs2.ordinal_number "
+                                           "ORDER BY bl.name, bl.direction, bd1.time";
+            pending_first_legs.emplace(pipe.insert(query_second_bus), first_leg);
+        }
+
+        // N queries come back here, so they are not mixed into the per-query SQL histogram
+        ScopedLatency timer(LatencyEndpoint::SqlPipeline);
+        while (!pipe.empty()) {
+            auto [query_id, result_second_bus] = pipe.retrieve();
+            const FirstLeg &first_leg = pending_first_legs[query_id];
+
+            for (auto row_second_bus : result_second_bus) {
+                std::string second_bus_line = row_second_bus["name"].c_str();
+                std::string second_direction = row_second_bus["direction"].c_str();
+                if (first_bus_list.find({second_bus_line, second_direction}) != first_bus_list.end()) {
+                    continue;
+                }
+
+                SolutionTwoBuses solTwoBuses;
+                solTwoBuses.bus_line = first_leg.bus_line;
+                solTwoBuses.direction = first_leg.direction;
+                solTwoBuses.departure_time = first_leg.departure_time;
+                solTwoBuses.arrival_time = first_leg.arrival_time;
+                solTwoBuses.start_stop = first_leg.start_stop;
+                solTwoBuses.goal_stop = first_leg.second_stop;
+
+                solTwoBuses.second_bus_line = second_bus_line;
+                solTwoBuses.second_departure_time = row_second_bus["departure_time"].c_str();
+                solTwoBuses.second_arrival_time = row_second_bus["arrival_time"].c_str();
+                solTwoBuses.second_start_stop = first_leg.second_stop;
+                solTwoBuses.second_goal_stop = goal_names[row_second_bus["goal_stop_id"].c_str()];
+                solTwoBuses.second_direction = second_direction;
+
+                auto second_key = std::make_pair(second_bus_line, second_direction);
+                if (earliest_solutions.find(second_key) == earliest_solutions.end() || solTwoBuses.second_departure_time < earliest_solutions[second_key].second_departure_time) {
+                    earliest_solutions[second_key] = solTwoBuses;
+                }
+            }
+        }
+    }
+
+    txn.commit();
+
+    for (const auto &entry : earliest_solutions) {
+        solutions.push_back(entry.second);
+    }
+
+    return solutions;
+}
+
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes_batched(pqxx::connection &conn, const std::string &date, const std::string &time, Coordinates start_coords, Coordinates goal_coords, std::shared_ptr<const TimetableSnapshot> snapshot) {
+    ScopedLatency timer(LatencyEndpoint::FindRoutesBatched);
+    QueryContext context = make_query_context(conn, date, time, start_coords, goal_coords);
+    context.snapshot = std::move(snapshot);
+    std::vector<Solution> solutions_without_changing_bus = find_route_without_changing_bus_batched(conn, context);
+
+    // Collect used bus lines
+    std::set<std::string> used_buses;
+    for (const auto &sol : solutions_without_changing_bus) {
+        used_buses.insert(sol.bus_line);
+    }
+
+    std::vector<std::variant<Solution, SolutionTwoBuses>> all_solutions;
+    all_solutions.insert(all_solutions.end(), solutions_without_changing_bus.begin(), solutions_without_changing_bus.end());
+
+    std::vector<std::variant<Solution, SolutionTwoBuses>> solutions_with_changing_bus = find_route_with_changing_bus_batched(conn, context, used_buses);
+    all_solutions.insert(all_solutions.end(), solutions_with_changing_bus.begin(), solutions_with_changing_bus.end());
+
+    return all_solutions;
+}
@@ -0,0 +1,17 @@
+#ifndef BATCHED_H
+#define BATCHED_H
+
+#include <string>
+#include <vector>
+#include <variant>
+#include <set>
+#include <pqxx/pqxx>
+#include "sequence.h"
+
+// Route search that sends one set-based query per phase instead of one query per candidate stop
+
+std::vector<Solution> find_route_without_changing_bus_batched(pqxx::connection &conn, const QueryContext &context);
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_route_with_changing_bus_batched(pqxx::connection &conn, const QueryContext &context, const std::set<std::string> &used_buses);
+// With a snapshot (current with the database) the one-change phase skips the stops and lines that cannot lead to a goal
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes_batched(pqxx::connection &conn, const std::string &date, const std::string &time, Coordinates start_coords, Coordinates goal_coords, std::shared_ptr<const TimetableSnapshot> snapshot = nullptr);
+#endif // BATCHED_H
@@ -0,0 +1,43 @@
+// Writes the binary timetable file that routing processes map at startup.
+//
+// Usage:
+//     build_timetable <output file> [--db CONNINFO]
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <pqxx/pqxx>
+#include "timetable.h"
+
+int main(int argc, char **argv) {
+    if ((argc != 2 && argc != 4) || (argc == 4 && std::string(argv[2]) != "--db")) {
+        std::cerr << "Usage: build_timetable <output file> [--db CONNINFO]" << std::endl;
+        return 1;
+    }
+
+    std::string output_path = argv[1];
+    std::string db = "dbname=ebus2 user=dawid password=Dragon11 host=localhost port=5432";
+    if (argc == 4) {
+        db = argv[3];
+    }
+
+    try {
+        pqxx::connection conn(db);
+        auto start_time = std::chrono::steady_clock::now();
+
+        Timetable timetable = load_timetable(conn);
+        write_timetable_file(timetable, output_path);
+
+        std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start_time;
+        std::cout << "Stops: " << timetable.stop_count
+                  << ", lines: " << timetable.line_count
+                  << ", stops in lines: " << timetable.stop_in_line_count
+                  << ", departures: " << timetable.departures.count << std::endl;
+        std::cout << "Wrote " << timetable.image_size << " bytes to " << output_path
+                  << " in " << elapsed_time.count() << " seconds" << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+// Precomputes the transfer patterns of one day type from a timetable file written by
+// build_timetable. This is a heavy batch job: one full-day profile search per origin stop,
+// spread over all cores. Rebuild the patterns whenever the timetable file is rebuilt: the
+// file records a fingerprint of the timetable, and queries refuse patterns that do not match.
+//
+// Usage:
+//     build_transfer_patterns <timetable file> <output file> [--day working|saturday|sunday]
+//                             [--origins ID,ID,...]
+#include <iostream>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "timetable.h"
+#include "snapshot.h"
+#include "transfer_patterns.h"
+
+int main(int argc, char **argv) {
+    if (argc < 3 || argc % 2 != 1) {
+        std::cerr << "Usage: build_transfer_patterns <timetable file> <output file> [--day working|saturday|sunday] [--origins ID,ID,...]" << std::endl;
+        return 1;
+    }
+
+    std::string timetable_path = argv[1];
+    std::string output_path = argv[2];
+    DayType day_type = DayType::Working;
+    std::vector<int32_t> origins;
+
+    try {
+        for (int i = 3; i < argc; i += 2) {
+            std::string arg = argv[i];
+            std::string value = argv[i + 1];
+            if (arg == "--day") {
+                if (value == "working") {
+                    day_type = DayType::Working;
+                } else if (value == "saturday") {
+                    day_type = DayType::Saturday;
+                } else if (value == "sunday") {
+                    day_type = DayType::Sunday;
+                } else {
+                    throw std::runtime_error("Unknown day type " + value);
+                }
+            } else if (arg == "--origins") {
+                std::istringstream ss(value);
+                std::string id;
+                while (std::getline(ss, id, ',')) {
+                    origins.push_back(std::stoi(id));
+                }
+            } else {
+                throw std::runtime_error("Unknown option " + arg);
+            }
+        }
+
+        auto start_time = std::chrono::steady_clock::now();
+        std::shared_ptr<const TimetableSnapshot> snapshot = make_snapshot(open_timetable_file(timetable_path), 1);
+        TransferPatterns patterns = build_transfer_patterns(snapshot->partition(day_type), origins);
+        write_transfer_patterns(patterns, output_path);
+
+        size_t node_count = 0;
+        size_t sequence_count = 0;
+        for (const TransferPatternGraph &graph : patterns.graphs) {
+            node_count += graph.node_stop_id.size();
+            sequence_count += graph.target_nodes.size();
+        }
+        std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start_time;
+        std::cout << "Origins: " << patterns.graphs.size()
+                  << ", DAG nodes: " << node_count
+                  << ", stop sequences: " << sequence_count << std::endl;
+        std::cout << "Wrote " << output_path << " in " << elapsed_time.count() << " seconds" << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
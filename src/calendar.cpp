@@ -0,0 +1,164 @@
+#include "calendar.h"
+#include "database_queries.h"
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+static_assert(static_cast<uint8_t>(DayType::Working) == ROUTE_DAY_WORKING, "day type codes must match route_day codes");
+static_assert(static_cast<uint8_t>(DayType::Saturday) == ROUTE_DAY_SATURDAY, "day type codes must match route_day codes");
+static_assert(static_cast<uint8_t>(DayType::Sunday) == ROUTE_DAY_SUNDAY, "day type codes must match route_day codes");
+
+// Years covered by the precomputed table; other dates fall back to the weekday rule
+static const int CALENDAR_FIRST_YEAR = 2000;
+static const int CALENDAR_LAST_YEAR = 2099;
+
+const char *day_type_name(DayType day_type) {
+    switch (day_type) {
+        case DayType::Working: return "Roboczy";
+        case DayType::Saturday: return "Sobota";
+        default: return "Niedziela i święta";
+    }
+}
+
+// Function to count days since 1970-01-01 (proleptic Gregorian calendar)
+static int64_t days_from_civil(int year, int month, int day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t year_of_era = year - era * 400;
+    int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+// Function to give the number of days in a month, leap years included
+static int days_in_month(int year, int month) {
+    static const int month_lengths[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap_year = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    return month == 2 && leap_year ? 29 : month_lengths[month - 1];
+}
+
+// 0 = Sunday ... 6 = Saturday, like std::tm::tm_wday
+static int weekday(int64_t days) {
+    return static_cast<int>(days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6);
+}
+
+// Function to compute Easter Sunday (anonymous Gregorian algorithm), as days since 1970-01-01
+static int64_t easter_sunday(int year) {
+    int a = year % 19;
+    int b = year / 100;
+    int c = year % 100;
+    int d = b / 4;
+    int e = b % 4;
+    int f = (b + 8) / 25;
+    int g = (b - f + 1) / 3;
+    int h = (19 * a + b - d - g + 15) % 30;
+    int i = c / 4;
+    int k = c % 4;
+    int l = (32 + 2 * e + 2 * i - h - k) % 7;
+    int m = (a + 11 * h + 22 * l) / 451;
+    int month = (h + l - 7 * m + 114) / 31;
+    int day = (h + l - 7 * m + 114) % 31 + 1;
+    return days_from_civil(year, month, day);
+}
+
+bool is_public_holiday(int year, int month, int day) {
+    struct FixedHoliday {
+        int month;
+        int day;
+        int since;
+    };
+    static const FixedHoliday fixed_holidays[] = {
+        {1, 1, 0},     // Nowy Rok
+        {1, 6, 2011},  // Trzech Króli
+        {5, 1, 0},     // Święto Pracy
+        {5, 3, 0},     // Święto Konstytucji 3 Maja
+        {8, 15, 0},    // Wniebowzięcie NMP
+        {11, 1, 0},    // Wszystkich Świętych
+        {11, 11, 0},   // Święto Niepodległości
+        {12, 24, 2025}, // Wigilia
+        {12, 25, 0},   // Boże Narodzenie
+        {12, 26, 0},   // drugi dzień Bożego Narodzenia
+    };
+    for (const auto &holiday : fixed_holidays) {
+        if (holiday.month == month && holiday.day == day && year >= holiday.since) {
+            return true;
+        }
+    }
+
+    // Easter Monday, Pentecost and Corpus Christi move with Easter
+    int64_t offset = days_from_civil(year, month, day) - easter_sunday(year);
+    return offset == 0 || offset == 1 || offset == 49 || offset == 60;
+}
+
+// Function to classify a date without the table
+static DayType compute_day_type(int year, int month, int day) {
+    if (is_public_holiday(year, month, day)) {
+        return DayType::Sunday;
+    }
+    int wday = weekday(days_from_civil(year, month, day));
+    if (wday >= 1 && wday <= 5) {
+        return DayType::Working;
+    } else if (wday == 6) {
+        return DayType::Saturday;
+    }
+    return DayType::Sunday;
+}
+
+// Day type of every date in the covered years, indexed by days since CALENDAR_FIRST_YEAR-01-01
+static const std::vector<DayType> &calendar_table() {
+    static const std::vector<DayType> table = []() {
+        std::vector<DayType> days;
+        for (int year = CALENDAR_FIRST_YEAR; year <= CALENDAR_LAST_YEAR; ++year) {
+            for (int month = 1; month <= 12; ++month) {
+                for (int day = 1; day <= days_in_month(year, month); ++day) {
+                    days.push_back(compute_day_type(year, month, day));
+                }
+            }
+        }
+        return days;
+    }();
+    return table;
+}
+
+// Function to read a fixed-width decimal field
+static bool parse_digits(const std::string &text, size_t position, size_t length, int &value) {
+    value = 0;
+    for (size_t i = position; i < position + length; ++i) {
+        if (text[i] < '0' || text[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (text[i] - '0');
+    }
+    return true;
+}
+
+DayType day_type_for_date(const std::string &date_str) {
+    int year, month, day;
+    if (date_str.size() != 10 || date_str[4] != '-' || date_str[7] != '-' ||
+        !parse_digits(date_str, 0, 4, year) || !parse_digits(date_str, 5, 2, month) || !parse_digits(date_str, 8, 2, day) ||
+        month < 1 || month > 12 || day < 1 || day > days_in_month(year, month)) {
+        throw std::runtime_error("Failed to parse date");
+    }
+
+    if (year < CALENDAR_FIRST_YEAR || year > CALENDAR_LAST_YEAR) {
+        return compute_day_type(year, month, day);
+    }
+    return calendar_table()[days_from_civil(year, month, day) - days_from_civil(CALENDAR_FIRST_YEAR, 1, 1)];
+}
+
+int32_t parse_time_of_day(const std::string &time_str) {
+    int hours, minutes, seconds = 0;
+    if ((time_str.size() != 5 && time_str.size() != 8) || time_str[2] != ':' ||
+        !parse_digits(time_str, 0, 2, hours) || !parse_digits(time_str, 3, 2, minutes) ||
+        (time_str.size() == 8 && (time_str[5] != ':' || !parse_digits(time_str, 6, 2, seconds))) ||
+        minutes > 59 || seconds > 59) {
+        throw std::runtime_error("Failed to parse time");
+    }
+    return hours * 3600 + minutes * 60 + seconds;
+}
+
+std::string format_time_of_day(int32_t seconds) {
+    char buffer[16];
+    std::snprintf(buffer, sizeof(buffer), "%02d:%02d:%02d", seconds / 3600, seconds / 60 % 60, seconds % 60);
+    return buffer;
+}
@@ -0,0 +1,31 @@
+#ifndef CALENDAR_H
+#define CALENDAR_H
+
+#include <cstdint>
+#include <string>
+
+// Timetable day types; the values are the route_day codes used by the loaders
+enum class DayType : uint8_t {
+    Working = 0,
+    Saturday = 1,
+    Sunday = 2, // Sundays and public holidays
+};
+
+const int DAY_TYPE_COUNT = 3;
+
+// Name used in route_search_busdeparture.route_day: "Roboczy", "Sobota" or "Niedziela i święta"
+const char *day_type_name(DayType day_type);
+
+// Function to map a YYYY-MM-DD date to its day type through a precomputed calendar that
+// knows Polish public holidays; throws std::runtime_error on a malformed or nonexistent
+// date (e.g. 2023-02-29)
+DayType day_type_for_date(const std::string &date_str);
+
+bool is_public_holiday(int year, int month, int day);
+
+// Times of day as seconds since midnight, the unit of DepartureColumns::time.
+// parse_time_of_day accepts HH:MM or HH:MM:SS; format_time_of_day gives HH:MM:SS like Postgres
+int32_t parse_time_of_day(const std::string &time_str);
+std::string format_time_of_day(int32_t seconds);
+
+#endif // CALENDAR_H
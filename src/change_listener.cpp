@@ -0,0 +1,161 @@
+#include <iostream>
+#include <pqxx/pqxx>
+#include "change_listener.h"
+#include "database_queries.h"
+#include "json.hpp"
+
+static const char *CHANGE_TABLES[] = {
+    "route_search_busline",
+    "route_search_busstop",
+    "route_search_busstopinbusline",
+    "route_search_busdeparture",
+};
+
+void install_change_triggers(pqxx::connection &conn) {
+    pqxx::work txn(conn);
+    // Row payloads carry only the key the listener narrows the change down by, so every row
+    // of one line (and the old and new version of a row) gives the same payload, and Postgres
+    // folds the duplicates of a transaction into a single notification
+    exec_timed(txn, "CREATE OR REPLACE FUNCTION route_search_notify_change() RETURNS trigger AS $$ "
+                    "DECLARE "
+                    "    key text; "
+                    "BEGIN "
+                    "    IF TG_OP = 'TRUNCATE' THEN "
+                    "        PERFORM pg_notify('" + std::string(CHANGE_CHANNEL) + "', json_build_object('table', TG_TABLE_NAME, 'op', TG_OP)::text); "
+                    "        RETURN NULL; "
+                    "    END IF; "
+                    "    IF TG_TABLE_NAME IN ('route_search_busstopinbusline', 'route_search_busdeparture') THEN "
+                    "        key := 'bus_line_id'; "
+                    "    ELSE "
+                    "        key := 'id'; "
+                    "    END IF; "
+                    "    IF TG_OP <> 'INSERT' THEN "
+                    "        PERFORM pg_notify('" + std::string(CHANGE_CHANNEL) + "', json_build_object('table', TG_TABLE_NAME, "
+                    "            key, to_jsonb(OLD)->key)::text); "
+                    "    END IF; "
+                    "    IF TG_OP <> 'DELETE' THEN "
+                    "        PERFORM pg_notify('" + std::string(CHANGE_CHANNEL) + "', json_build_object('table', TG_TABLE_NAME, "
+                    "            key, to_jsonb(NEW)->key)::text); "
+                    "    END IF; "
+                    "    RETURN NULL; "
+                    "END; "
+                    "$$ LANGUAGE plpgsql");
+
+    for (const char *table : CHANGE_TABLES) {
+        std::string name = table;
+        exec_timed(txn, "DROP TRIGGER IF EXISTS route_search_notify_row ON " + name);
+        exec_timed(txn, "DROP TRIGGER IF EXISTS route_search_notify_truncate ON " + name);
+        exec_timed(txn, "CREATE TRIGGER route_search_notify_row AFTER INSERT OR UPDATE OR DELETE ON " + name +
+                        " FOR EACH ROW EXECUTE PROCEDURE route_search_notify_change()");
+        exec_timed(txn, "CREATE TRIGGER route_search_notify_truncate AFTER TRUNCATE ON " + name +
+                        " FOR EACH STATEMENT EXECUTE PROCEDURE route_search_notify_change()");
+    }
+
+    txn.commit();
+}
+
+ChangeSet parse_change_notification(const std::string &payload) {
+    ChangeSet changes;
+    try {
+        auto notification = nlohmann::json::parse(payload);
+        std::string table = notification.value("table", "");
+        std::string op = notification.value("op", "");
+
+        // Column used to narrow the change down, per table
+        const char *line_key = nullptr;
+        const char *stop_key = nullptr;
+        if (table == "route_search_busline") {
+            line_key = "id";
+        } else if (table == "route_search_busstop") {
+            stop_key = "id";
+        } else if (table == "route_search_busstopinbusline" || table == "route_search_busdeparture") {
+            line_key = "bus_line_id";
+        }
+
+        if (op == "TRUNCATE" || (line_key == nullptr && stop_key == nullptr)) {
+            changes.full = true;
+        } else if (line_key != nullptr && notification[line_key].is_number_integer()) {
+            changes.lines.insert(notification[line_key].get<int32_t>());
+        } else if (stop_key != nullptr && notification[stop_key].is_number_integer()) {
+            changes.stops.insert(notification[stop_key].get<int32_t>());
+        } else {
+            changes.full = true;
+        }
+    } catch (const nlohmann::json::exception &e) {
+        std::cerr << "Unreadable change notification: " << e.what() << std::endl;
+        changes.full = true;
+    }
+    return changes;
+}
+
+// Forwards notifications on the change channel to the listener
+class ChangeReceiver : public pqxx::notification_receiver {
+public:
+    ChangeReceiver(pqxx::connection &conn, ChangeListener &listener)
+        : pqxx::notification_receiver(conn, CHANGE_CHANNEL), listener(listener) {}
+
+    void operator()(const std::string &payload, int) override {
+        listener.on_notification(payload);
+    }
+
+private:
+    ChangeListener &listener;
+};
+
+ChangeListener::ChangeListener(std::string connection_string, Handler handler,
+                               std::chrono::milliseconds quiet_period, std::chrono::milliseconds max_delay)
+    : connection_string(std::move(connection_string)), handler(std::move(handler)),
+      quiet_period(quiet_period), max_delay(max_delay) {
+    listen_thread = std::thread(&ChangeListener::listen_loop, this);
+}
+
+ChangeListener::~ChangeListener() {
+    stopping = true;
+    listen_thread.join();
+}
+
+void ChangeListener::on_notification(const std::string &payload) {
+    auto now = std::chrono::steady_clock::now();
+    if (pending_changes.empty()) {
+        first_change = now;
+    }
+    last_change = now;
+    pending_changes.merge(parse_change_notification(payload));
+}
+
+void ChangeListener::listen_loop() {
+    bool connected_before = false;
+
+    while (!stopping) {
+        try {
+            pqxx::connection conn(connection_string);
+            ChangeReceiver receiver(conn, *this);
+
+            if (connected_before) {
+                ChangeSet everything;
+                everything.full = true;
+                pending_changes.merge(everything);
+                first_change = last_change = std::chrono::steady_clock::now();
+            }
+            connected_before = true;
+
+            while (!stopping) {
+                // Wakes up at least every 50 ms to check for shutdown and due batches
+                conn.await_notification(0, 50000);
+
+                auto now = std::chrono::steady_clock::now();
+                if (!pending_changes.empty() &&
+                    (now - last_change >= quiet_period || now - first_change >= max_delay)) {
+                    ChangeSet changes = std::move(pending_changes);
+                    pending_changes = ChangeSet();
+                    handler(changes);
+                }
+            }
+        } catch (const std::exception &e) {
+            std::cerr << "Change listener: " << e.what() << std::endl;
+            for (int i = 0; i < 10 && !stopping; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+    }
+}
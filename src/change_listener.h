@@ -0,0 +1,64 @@
+#ifndef CHANGE_LISTENER_H
+#define CHANGE_LISTENER_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <pqxx/pqxx>
+#include "timetable.h"
+
+// Channel the route_search_* triggers publish on
+const char CHANGE_CHANNEL[] = "route_search_changes";
+
+// Installs (or replaces) row and TRUNCATE triggers on the four route_search_* tables.
+// Every changed row sends a NOTIFY whose payload names the table and the id of the changed
+// stop or line (bus_line_id for stop sequences and departures), so the notifications of a
+// bulk update within one transaction collapse to one per stop or line.
+void install_change_triggers(pqxx::connection &conn);
+
+// Function to turn one notification payload into the stops and lines it touches
+ChangeSet parse_change_notification(const std::string &payload);
+
+// Listens for change notifications on a dedicated connection and hands them to a
+// handler in batches: a batch is delivered once the channel has been quiet for
+// quiet_period (or max_delay after its first change), so a bulk update of many rows
+// turns into one rebuild. After a lost connection everything is reported as changed,
+// because notifications sent while disconnected are gone.
+//
+//     TimetableStore store(loader, patcher);
+//     ChangeListener listener(conn_string, [&store](const ChangeSet &changes) { store.apply_changes(changes); });
+class ChangeListener {
+public:
+    using Handler = std::function<void(const ChangeSet &)>;
+
+    ChangeListener(std::string connection_string, Handler handler,
+                   std::chrono::milliseconds quiet_period = std::chrono::milliseconds(200),
+                   std::chrono::milliseconds max_delay = std::chrono::milliseconds(2000));
+    ~ChangeListener();
+
+    ChangeListener(const ChangeListener &) = delete;
+    ChangeListener &operator=(const ChangeListener &) = delete;
+
+    // Called by the receiver on the listener thread
+    void on_notification(const std::string &payload);
+
+private:
+    void listen_loop();
+
+    std::string connection_string;
+    Handler handler;
+    std::chrono::milliseconds quiet_period;
+    std::chrono::milliseconds max_delay;
+
+    // Only touched by the listener thread
+    ChangeSet pending_changes;
+    std::chrono::steady_clock::time_point first_change;
+    std::chrono::steady_clock::time_point last_change;
+
+    std::atomic<bool> stopping{false};
+    std::thread listen_thread;
+};
+
+#endif // CHANGE_LISTENER_H
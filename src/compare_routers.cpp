@@ -0,0 +1,258 @@
+// Randomized agreement check of the in-memory routers against raptor_earliest_arrival:
+// random origin and goal stops (with walks), departure times and leg limits, on a timetable
+// file written by build_timetable or on generated networks. The trip-based engine and the
+// transfer patterns have to return the same number of journeys, with the same number of
+// legs and the same arrival times, as RAPTOR. The first disagreement is printed and the
+// exit code is 1, so the generated networks run as a test.
+//
+// Usage:
+//     compare_routers --timetable <timetable file> [--day working|saturday|sunday] [--patterns FILE]
+//                     [--queries N] [--seed S]
+//     compare_routers --random <networks> [--queries N] [--seed S]
+//
+// With --timetable the transfer patterns are only checked if --patterns names a file that
+// build_transfer_patterns wrote from that timetable, and their day type replaces --day;
+// generated networks get theirs built here.
+#include <iostream>
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "timetable.h"
+#include "snapshot.h"
+#include "calendar.h"
+#include "raptor.h"
+#include "trip_based.h"
+#include "transfer_patterns.h"
+
+// Function to generate a small network running on working days: lines over random stop
+// sequences, half of them also running the reverse direction, with a few dozen trips each
+Timetable random_network(std::mt19937 &rng) {
+    std::string strings;
+    auto add_string = [&strings](const std::string &value) {
+        uint32_t offset = static_cast<uint32_t>(strings.size());
+        strings += value;
+        return offset;
+    };
+
+    int stop_count = 20 + static_cast<int>(rng() % 30);
+    std::vector<StopRecord> stops;
+    for (int id = 1; id <= stop_count; ++id) {
+        std::string name = "Stop " + std::to_string(id);
+        stops.push_back({id, add_string(name), static_cast<uint32_t>(name.size()), 0,
+                         51.6 + (rng() % 1000) * 1e-4, 17.8 + (rng() % 1000) * 1e-4});
+    }
+
+    std::vector<LineRecord> lines;
+    std::vector<StopInLineRecord> stops_in_lines;
+    DepartureColumns departures;
+    int line_count = 5 + static_cast<int>(rng() % 10);
+    for (int l = 1; l <= line_count; ++l) {
+        std::vector<int32_t> all_stops;
+        for (int id = 1; id <= stop_count; ++id) {
+            all_stops.push_back(id);
+        }
+        std::shuffle(all_stops.begin(), all_stops.end(), rng);
+        std::vector<int32_t> sequence(all_stops.begin(), all_stops.begin() + 3 + rng() % 8);
+        std::vector<int32_t> hop_seconds(sequence.size(), 0);
+        for (size_t k = 1; k < sequence.size(); ++k) {
+            hop_seconds[k] = 60 * (1 + static_cast<int32_t>(rng() % 5));
+        }
+        int32_t first_departure = 5 * 3600 + 60 * static_cast<int32_t>(rng() % 90);
+        int32_t headway = 60 * (4 + static_cast<int32_t>(rng() % 30));
+        int trip_count = 5 + static_cast<int>(rng() % 30);
+        std::string name = std::to_string(l);
+
+        int directions = rng() % 2 == 0 ? 2 : 1;
+        for (int direction = 0; direction < directions; ++direction) {
+            int32_t line_id = l * 10 + direction;
+            std::string direction_name = direction == 0 ? "Stop " + std::to_string(sequence.back()) : "Stop " + std::to_string(sequence.front());
+            lines.push_back({line_id, add_string(name), static_cast<uint32_t>(name.size()), add_string(direction_name), static_cast<uint32_t>(direction_name.size())});
+
+            std::vector<int32_t> visited = sequence;
+            if (direction == 1) {
+                std::reverse(visited.begin(), visited.end());
+            }
+            for (size_t k = 0; k < visited.size(); ++k) {
+                stops_in_lines.push_back({line_id, visited[k], static_cast<int32_t>(k + 1)});
+            }
+            for (int trip = 0; trip < trip_count; ++trip) {
+                int32_t time = first_departure + trip * headway + direction * 420;
+                for (size_t k = 0; k < visited.size(); ++k) {
+                    time += hop_seconds[k];
+                    size_t row = departures.size();
+                    departures.resize(row + 1);
+                    departures.id[row] = static_cast<int32_t>(row + 1);
+                    departures.bus_line_id[row] = line_id;
+                    departures.bus_stop_id[row] = visited[k];
+                    departures.departure_ordinal_number[row] = trip + 1;
+                    departures.time[row] = time;
+                    departures.route_day[row] = ROUTE_DAY_WORKING;
+                }
+            }
+        }
+    }
+
+    return build_timetable(std::move(stops), std::move(lines), std::move(stops_in_lines), departures, strings);
+}
+
+// Function to pick one to three stops of the partition, each with a walk of up to 5 minutes
+std::vector<StopAccess> random_access(const DayPartition &partition, std::mt19937 &rng) {
+    std::vector<StopAccess> access;
+    int count = 1 + static_cast<int>(rng() % 3);
+    for (int i = 0; i < count; ++i) {
+        access.push_back({partition.stop_ids[rng() % partition.stop_count()], 60 * static_cast<int32_t>(rng() % 6)});
+    }
+    return access;
+}
+
+// Function to describe the answer of one router for a disagreement report
+std::string describe(const std::vector<Journey> &journeys) {
+    std::ostringstream out;
+    for (const Journey &journey : journeys) {
+        out << " [" << journey.legs.size() << " legs, " << format_time_of_day(journey.departure_time) << " -> " << format_time_of_day(journey.arrival_time) << "]";
+    }
+    return journeys.empty() ? " none" : out.str();
+}
+
+// Function to tell whether a router gave the same journeys as RAPTOR, as far as routers can agree
+bool same_arrivals(const std::vector<Journey> &expected, const std::vector<Journey> &actual) {
+    if (expected.size() != actual.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < expected.size(); ++i) {
+        if (expected[i].legs.size() != actual[i].legs.size() || expected[i].arrival_time != actual[i].arrival_time) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to report a disagreement with RAPTOR
+void report(const std::string &router, int32_t departure_time, int max_legs, const std::vector<Journey> &expected, const std::vector<Journey> &actual) {
+    std::cerr << router << " disagrees with RAPTOR at " << format_time_of_day(departure_time)
+              << " with at most " << max_legs << " legs:" << std::endl;
+    std::cerr << "    raptor:" << describe(expected) << std::endl;
+    std::cerr << "    " << router << ":" << describe(actual) << std::endl;
+}
+
+// Function to run random queries on one partition, checking the transfer patterns too when
+// given; returns the number of disagreements (at most one, as the check stops at the first)
+long compare_on_partition(std::shared_ptr<const DayPartition> partition, int32_t change_seconds, const TransferPatterns *patterns, long queries, std::mt19937 &rng) {
+    if (partition->stop_count() == 0) {
+        return 0;
+    }
+    std::shared_ptr<const TripBasedIndex> trip_based_index = build_trip_based_index(partition, change_seconds);
+
+    for (long q = 0; q < queries; ++q) {
+        std::vector<StopAccess> origins = random_access(*partition, rng);
+        std::vector<StopAccess> goals = random_access(*partition, rng);
+        int32_t departure_time = 4 * 3600 + static_cast<int32_t>(rng() % (20 * 3600));
+        RaptorOptions options;
+        options.max_legs = 1 + static_cast<int>(rng() % 4);
+        options.change_seconds = change_seconds;
+
+        std::vector<Journey> expected = raptor_earliest_arrival(*partition, origins, goals, departure_time, options);
+        std::vector<Journey> trip_based = trip_based_earliest_arrival(*trip_based_index, origins, goals, departure_time, options.max_legs);
+        if (!same_arrivals(expected, trip_based)) {
+            report("trip-based", departure_time, options.max_legs, expected, trip_based);
+            return 1;
+        }
+
+        if (patterns) {
+            // The patterns answer with the options they were built with
+            RaptorOptions pattern_options;
+            pattern_options.max_legs = patterns->max_legs;
+            pattern_options.change_seconds = patterns->change_seconds;
+            expected = raptor_earliest_arrival(*partition, origins, goals, departure_time, pattern_options);
+            std::vector<Journey> from_patterns = transfer_pattern_query(*patterns, *partition, origins, goals, departure_time);
+            if (!same_arrivals(expected, from_patterns)) {
+                report("transfer-patterns", departure_time, patterns->max_legs, expected, from_patterns);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3 || argc % 2 != 1) {
+        std::cerr << "Usage: compare_routers (--timetable <timetable file> [--day working|saturday|sunday] | --random <networks>) [--queries N] [--seed S]" << std::endl;
+        return 1;
+    }
+
+    try {
+        std::string timetable_path;
+        std::string patterns_path;
+        int networks = 0;
+        DayType day_type = DayType::Working;
+        long queries = 1000;
+        unsigned seed = 1;
+        for (int i = 1; i < argc; i += 2) {
+            std::string arg = argv[i];
+            std::string value = argv[i + 1];
+            if (arg == "--timetable") {
+                timetable_path = value;
+            } else if (arg == "--patterns") {
+                patterns_path = value;
+            } else if (arg == "--random") {
+                networks = std::stoi(value);
+            } else if (arg == "--day") {
+                if (value == "working") {
+                    day_type = DayType::Working;
+                } else if (value == "saturday") {
+                    day_type = DayType::Saturday;
+                } else if (value == "sunday") {
+                    day_type = DayType::Sunday;
+                } else {
+                    throw std::runtime_error("Unknown day type " + value);
+                }
+            } else if (arg == "--queries") {
+                queries = std::stol(value);
+            } else if (arg == "--seed") {
+                seed = static_cast<unsigned>(std::stoul(value));
+            } else {
+                throw std::runtime_error("Unknown option " + arg);
+            }
+        }
+        if (timetable_path.empty() == (networks == 0)) {
+            throw std::runtime_error("Give either --timetable or --random");
+        }
+
+        std::mt19937 rng(seed);
+        long mismatches = 0;
+        long total = 0;
+        if (!timetable_path.empty()) {
+            std::shared_ptr<const TimetableSnapshot> snapshot = make_snapshot(open_timetable_file(timetable_path), 1);
+            TransferPatterns patterns;
+            if (!patterns_path.empty()) {
+                patterns = read_transfer_patterns(patterns_path);
+                day_type = patterns.day_type;
+            }
+            mismatches = compare_on_partition(snapshot->partitions[static_cast<int>(day_type)], patterns.change_seconds,
+                                              patterns_path.empty() ? nullptr : &patterns, queries, rng);
+            total = queries;
+        }
+        for (int network = 0; network < networks && mismatches == 0; ++network) {
+            std::shared_ptr<const TimetableSnapshot> snapshot = make_snapshot(random_network(rng), 1);
+            // Every other network with a minimum change time, which every router adds at a change
+            RaptorOptions options;
+            options.max_legs = 3;
+            options.change_seconds = network % 2 == 0 ? 0 : 120;
+            std::shared_ptr<const DayPartition> partition = snapshot->partitions[static_cast<int>(DayType::Working)];
+            TransferPatterns patterns = build_transfer_patterns(*partition, {}, options);
+            mismatches = compare_on_partition(partition, options.change_seconds, &patterns, queries, rng);
+            if (mismatches != 0) {
+                std::cerr << "Network " << network << " of seed " << seed << std::endl;
+            }
+            total += queries;
+        }
+
+        std::cout << "Queries: " << total << ", disagreements: " << mismatches << std::endl;
+        return mismatches == 0 ? 0 : 1;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,49 @@
+// Prints every stop reachable from an address within a time budget, from a timetable file
+// written by build_timetable. The address is geocoded like in find_routes.
+//
+// Usage:
+//     compute_isochrone <timetable file> <address> <YYYY-MM-DD> <HH:MM> <budget minutes>
+//
+// One line per stop, earliest first, tab-separated: stop id, name, arrival time, rides
+// taken (0 when walked to) and how many meters one can still walk from the stop.
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <curl/curl.h>
+#include "timetable.h"
+#include "snapshot.h"
+#include "calendar.h"
+#include "isochrone.h"
+
+int main(int argc, char **argv) {
+    if (argc != 6) {
+        std::cerr << "Usage: compute_isochrone <timetable file> <address> <YYYY-MM-DD> <HH:MM> <budget minutes>" << std::endl;
+        return 1;
+    }
+
+    try {
+        int budget_minutes = std::stoi(argv[5]);
+        if (budget_minutes <= 0) {
+            throw std::runtime_error("The budget must be a positive number of minutes");
+        }
+
+        std::shared_ptr<const TimetableSnapshot> snapshot = make_snapshot(open_timetable_file(argv[1]), 1);
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        auto start_time = std::chrono::steady_clock::now();
+        std::vector<IsochroneStop> stops = compute_isochrone_from_address(*snapshot, argv[2], argv[3], argv[4], budget_minutes * 60);
+        std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start_time;
+        curl_global_cleanup();
+
+        for (const IsochroneStop &stop : stops) {
+            std::cout << stop.stop_id << '\t' << stop.name << '\t' << format_time_of_day(stop.arrival_time) << '\t'
+                      << stop.legs << '\t' << static_cast<long>(stop.fringe_meters) << std::endl;
+        }
+        std::cerr << "Stops: " << stops.size() << ", computed in " << elapsed_time.count() << " seconds" << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
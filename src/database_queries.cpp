@@ -1,6 +1,13 @@
 #include <iostream>
 #include <pqxx/pqxx>
+#include <libpq-fe.h>
+#include <cstring>
+#include <atomic>
+#include <stdexcept>
+#include <omp.h>
 #include "database_queries.h"
+#include "latency.h"
+#include "openmp.h"
 
 void execute_query(pqxx::connection &conn, const std::string &query) {
     pqxx::work txn(conn);
@@ -22,3 +29,246 @@ void execute_queries(pqxx::connection &conn) {
     execute_query(conn, "SELECT * FROM route_search_busstopinbusline");
     execute_query(conn, "SELECT * FROM route_search_busdeparture");
 }
+
+pqxx::result exec_timed(pqxx::transaction_base &txn, const std::string &query) {
+    ScopedLatency timer(LatencyEndpoint::Sql);
+    return txn.exec(query);
+}
+
+std::string to_pg_array(const std::vector<std::string> &values) {
+    std::string array = "{";
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i > 0) {
+            array += ',';
+        }
+        array += '"';
+        for (char c : values[i]) {
+            if (c == '"' || c == '\\') {
+                array += '\\';
+            }
+            array += c;
+        }
+        array += '"';
+    }
+    array += '}';
+    return array;
+}
+
+void DepartureColumns::resize(size_t count) {
+    id.resize(count);
+    bus_line_id.resize(count);
+    bus_stop_id.resize(count);
+    departure_ordinal_number.resize(count);
+    time.resize(count);
+    route_day.resize(count);
+}
+
+void DepartureColumns::append(const DepartureColumns &other) {
+    id.insert(id.end(), other.id.begin(), other.id.end());
+    bus_line_id.insert(bus_line_id.end(), other.bus_line_id.begin(), other.bus_line_id.end());
+    bus_stop_id.insert(bus_stop_id.end(), other.bus_stop_id.begin(), other.bus_stop_id.end());
+    departure_ordinal_number.insert(departure_ordinal_number.end(), other.departure_ordinal_number.begin(), other.departure_ordinal_number.end());
+    time.insert(time.end(), other.time.begin(), other.time.end());
+    route_day.insert(route_day.end(), other.route_day.begin(), other.route_day.end());
+}
+
+// Function to read a big-endian integer from the COPY stream
+static int32_t read_int32(const char *data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return static_cast<int32_t>(__builtin_bswap32(value));
+}
+
+static int16_t read_int16(const char *data) {
+    uint16_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return static_cast<int16_t>(__builtin_bswap16(value));
+}
+
+// Every column is cast to int4 and NULL rows are filtered out, so each tuple in the
+// binary stream has the same size and can be located without scanning the ones before it
+static const int DEPARTURE_COPY_FIELDS = 6;
+static const size_t DEPARTURE_TUPLE_SIZE = 2 + DEPARTURE_COPY_FIELDS * (4 + 4);
+// Tuples collected from the stream before they are decoded together (about 3 MB)
+static const size_t DEPARTURE_DECODE_BATCH = 65536;
+
+// Header: 11-byte signature, 32-bit flags, 32-bit header extension length
+static const char COPY_SIGNATURE[] = "PGCOPY\n\377\r\n";
+static const size_t COPY_SIGNATURE_SIZE = 11;
+static const size_t COPY_HEADER_SIZE = COPY_SIGNATURE_SIZE + 4 + 4;
+
+// Function to decode count whole tuples in parallel and append them to the columns
+static void decode_departure_tuples(const char *tuples, size_t count, DepartureColumns &departures) {
+    size_t first_row = departures.size();
+    departures.resize(first_row + count);
+
+    std::atomic<bool> malformed{false};
+    std::atomic<int32_t> unknown_route_day_id{-1};
+
+    #pragma omp parallel for num_threads(NUM_THREADS) schedule(static)
+    for (size_t i = 0; i < count; ++i) {
+        const char *tuple = tuples + i * DEPARTURE_TUPLE_SIZE;
+        if (read_int16(tuple) != DEPARTURE_COPY_FIELDS) {
+            malformed = true;
+            continue;
+        }
+
+        int32_t values[DEPARTURE_COPY_FIELDS];
+        const char *field = tuple + 2;
+        for (int f = 0; f < DEPARTURE_COPY_FIELDS; ++f) {
+            if (read_int32(field) != 4) {
+                malformed = true;
+            }
+            values[f] = read_int32(field + 4);
+            field += 8;
+        }
+        if (values[5] < ROUTE_DAY_WORKING || values[5] > ROUTE_DAY_SUNDAY) {
+            unknown_route_day_id = values[0];
+        }
+
+        size_t row = first_row + i;
+        departures.id[row] = values[0];
+        departures.bus_line_id[row] = values[1];
+        departures.bus_stop_id[row] = values[2];
+        departures.departure_ordinal_number[row] = values[3];
+        departures.time[row] = values[4];
+        departures.route_day[row] = static_cast<uint8_t>(values[5]);
+    }
+
+    if (malformed) {
+        throw std::runtime_error("Malformed tuple in COPY binary stream");
+    }
+    if (unknown_route_day_id >= 0) {
+        throw std::runtime_error("Unknown route_day in route_search_busdeparture row " + std::to_string(unknown_route_day_id.load()));
+    }
+}
+
+// Function to run the departure COPY with an optional extra condition on the rows, in the snapshot of txn
+static DepartureColumns copy_departures_binary(pqxx::transaction_base &txn, const std::string &condition) {
+    // libpqxx does not expose binary COPY, so the stream is read over a plain libpq connection.
+    // That connection imports the snapshot of txn, so it sees exactly the rows txn sees.
+    std::string snapshot_id = exec_timed(txn, "SELECT pg_export_snapshot()")[0][0].c_str();
+    PGconn *pg = PQconnectdb(txn.conn().connection_string().c_str());
+    if (PQstatus(pg) != CONNECTION_OK) {
+        std::string message = PQerrorMessage(pg);
+        PQfinish(pg);
+        throw std::runtime_error("Failed to connect for COPY: " + message);
+    }
+
+    // Run a command that returns no rows on the COPY connection
+    auto command = [pg](const std::string &sql) {
+        PGresult *result = PQexec(pg, sql.c_str());
+        bool ok = PQresultStatus(result) == PGRES_COMMAND_OK;
+        PQclear(result);
+        if (!ok) {
+            std::string message = PQerrorMessage(pg);
+            PQfinish(pg);
+            throw std::runtime_error("COPY setup failed: " + message);
+        }
+    };
+    command("BEGIN ISOLATION LEVEL REPEATABLE READ READ ONLY");
+    command("SET TRANSACTION SNAPSHOT '" + snapshot_id + "'");
+
+    // Unknown route_day values map to -1 and are rejected while decoding
+    std::string query = "COPY (SELECT id::int4, bus_line_id::int4, bus_stop_id::int4, departure_ordinal_number::int4, "
+                        "EXTRACT(EPOCH FROM time::time)::int4, "
+                        "(CASE route_day WHEN 'Roboczy' THEN 0 WHEN 'Sobota' THEN 1 WHEN 'Niedziela i święta' THEN 2 ELSE -1 END)::int4 "
+                        "FROM route_search_busdeparture "
+                        "WHERE id IS NOT NULL AND bus_line_id IS NOT NULL AND bus_stop_id IS NOT NULL "
+                        "AND departure_ordinal_number IS NOT NULL AND time IS NOT NULL AND route_day IS NOT NULL" +
+                        condition + ") TO STDOUT (FORMAT binary)";
+
+    DepartureColumns departures;
+    ScopedLatency timer(LatencyEndpoint::Sql);
+    PGresult *copy_result = PQexec(pg, query.c_str());
+    if (PQresultStatus(copy_result) != PGRES_COPY_OUT) {
+        std::string message = PQerrorMessage(pg);
+        PQclear(copy_result);
+        PQfinish(pg);
+        throw std::runtime_error("COPY failed: " + message);
+    }
+    PQclear(copy_result);
+
+    // libpq hands out one CopyData message per call. Whole tuples are decoded a batch at a
+    // time as they arrive, so only a partial batch is ever buffered, not the whole stream.
+    std::vector<char> pending;
+    size_t header_size = 0; // header length once it has been read, extension included
+    char *chunk = nullptr;
+    int length;
+    try {
+        while ((length = PQgetCopyData(pg, &chunk, 0)) > 0) {
+            pending.insert(pending.end(), chunk, chunk + length);
+            PQfreemem(chunk);
+
+            size_t offset = 0;
+            if (header_size == 0) {
+                if (pending.size() < COPY_HEADER_SIZE) {
+                    continue;
+                }
+                if (std::memcmp(pending.data(), COPY_SIGNATURE, COPY_SIGNATURE_SIZE) != 0) {
+                    throw std::runtime_error("Unexpected COPY binary header");
+                }
+                int32_t extension_size = read_int32(pending.data() + COPY_SIGNATURE_SIZE + 4);
+                if (extension_size < 0) {
+                    throw std::runtime_error("Unexpected COPY binary header");
+                }
+                if (pending.size() < COPY_HEADER_SIZE + static_cast<size_t>(extension_size)) {
+                    continue;
+                }
+                header_size = COPY_HEADER_SIZE + static_cast<size_t>(extension_size);
+                offset = header_size;
+            }
+
+            // The trailer is shorter than a tuple, so it is never taken for one
+            size_t tuple_count = (pending.size() - offset) / DEPARTURE_TUPLE_SIZE;
+            if (tuple_count >= DEPARTURE_DECODE_BATCH) {
+                decode_departure_tuples(pending.data() + offset, tuple_count, departures);
+                offset += tuple_count * DEPARTURE_TUPLE_SIZE;
+            }
+            pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(offset));
+        }
+
+        // Everything left must be whole tuples followed by the trailer, a 16-bit -1
+        if (length == -1) {
+            if (header_size == 0 || pending.size() < 2 || read_int16(pending.data() + pending.size() - 2) != -1 ||
+                (pending.size() - 2) % DEPARTURE_TUPLE_SIZE != 0) {
+                throw std::runtime_error("Unexpected COPY binary layout");
+            }
+            decode_departure_tuples(pending.data(), (pending.size() - 2) / DEPARTURE_TUPLE_SIZE, departures);
+        }
+    } catch (const std::exception &) {
+        PQfinish(pg);
+        throw;
+    }
+
+    PGresult *final_result = PQgetResult(pg);
+    bool copy_ok = length == -1 && PQresultStatus(final_result) == PGRES_COMMAND_OK;
+    std::string message = PQerrorMessage(pg);
+    PQclear(final_result);
+    PQfinish(pg);
+    if (!copy_ok) {
+        throw std::runtime_error("COPY stream failed: " + message);
+    }
+    return departures;
+}
+
+DepartureColumns load_departures_binary(pqxx::transaction_base &txn) {
+    return copy_departures_binary(txn, "");
+}
+
+DepartureColumns load_departures_binary(pqxx::transaction_base &txn, const std::vector<int32_t> &bus_line_ids) {
+    if (bus_line_ids.empty()) {
+        return DepartureColumns();
+    }
+
+    // COPY takes no parameters; the ids are integers, so they are safe to inline
+    std::string condition = " AND bus_line_id IN (";
+    for (size_t i = 0; i < bus_line_ids.size(); ++i) {
+        if (i > 0) {
+            condition += ',';
+        }
+        condition += std::to_string(bus_line_ids[i]);
+    }
+    condition += ')';
+    return copy_departures_binary(txn, condition);
+}
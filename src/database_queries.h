@@ -1,8 +1,55 @@
 #ifndef DATABASE_QUERIES_H
 #define DATABASE_QUERIES_H
 
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
 #include <pqxx/pqxx>
+#include "latency.h"
 
 void execute_queries(pqxx::connection &conn);
 
+// Runs a query and records its latency in the SQL histogram
+pqxx::result exec_timed(pqxx::transaction_base &txn, const std::string &query);
+
+// Same as exec_timed, for parameterised queries ($1, $2, ...)
+template <typename... Args>
+pqxx::result exec_params_timed(pqxx::transaction_base &txn, const std::string &query, Args &&...args) {
+    ScopedLatency timer(LatencyEndpoint::Sql);
+    return txn.exec_params(query, std::forward<Args>(args)...);
+}
+
+// Formats values as a Postgres array literal, e.g. {"12","15"}, to be bound to "= ANY($n)"
+std::string to_pg_array(const std::vector<std::string> &values);
+
+// Codes stored in DepartureColumns::route_day
+const uint8_t ROUTE_DAY_WORKING = 0;  // "Roboczy"
+const uint8_t ROUTE_DAY_SATURDAY = 1; // "Sobota"
+const uint8_t ROUTE_DAY_SUNDAY = 2;   // "Niedziela i święta"
+
+// route_search_busdeparture in columnar form, row i of the table is entry i of every column
+struct DepartureColumns {
+    std::vector<int32_t> id;
+    std::vector<int32_t> bus_line_id;
+    std::vector<int32_t> bus_stop_id;
+    std::vector<int32_t> departure_ordinal_number;
+    std::vector<int32_t> time; // seconds since midnight
+    std::vector<uint8_t> route_day;
+
+    size_t size() const { return id.size(); }
+    void resize(size_t count);
+    void append(const DepartureColumns &other);
+};
+
+// Streams route_search_busdeparture with COPY ... TO STDOUT (FORMAT binary) and decodes it
+// straight into columns, in parallel batches as the stream arrives. The COPY runs on its
+// own connection in the snapshot of txn (pg_export_snapshot), so with a REPEATABLE READ txn
+// it sees the same rows as every other query of txn. Rows with NULLs in any used column are
+// skipped; a route_day other than the three known names throws std::runtime_error.
+DepartureColumns load_departures_binary(pqxx::transaction_base &txn);
+
+// Same, restricted to the departures of the given lines
+DepartureColumns load_departures_binary(pqxx::transaction_base &txn, const std::vector<int32_t> &bus_line_ids);
+
 #endif
@@ -0,0 +1,45 @@
+#include "isochrone.h"
+#include <algorithm>
+#include "snapshot.h"
+#include "calendar.h"
+#include "latency.h"
+
+std::vector<IsochroneStop> compute_isochrone(const TimetableSnapshot &snapshot, Coordinates start_coords, const std::string &date, const std::string &start_time, int32_t budget_seconds, const RaptorOptions &options) {
+    ScopedLatency timer(LatencyEndpoint::Isochrone);
+    const DayPartition &partition = snapshot.partition(day_type_for_date(date));
+    int32_t start = parse_time_of_day(start_time);
+
+    // Walking to a start stop uses up part of the budget
+    std::vector<StopAccess> origins = candidate_stop_access(snapshot, start_coords);
+
+    RaptorOptions limited = options;
+    limited.arrive_by = false;
+    limited.max_duration = budget_seconds;
+    RaptorSearch search(partition, limited);
+    search.run(origins, start);
+
+    std::vector<IsochroneStop> reachable;
+    for (uint32_t stop = 0; stop < partition.stop_count(); ++stop) {
+        int32_t arrival = search.best_time(stop, limited.max_legs);
+        if (arrival == RAPTOR_UNREACHED || arrival - start > budget_seconds) {
+            continue;
+        }
+        int legs = 0;
+        while (search.best_time(stop, legs) != arrival) {
+            ++legs;
+        }
+        int32_t stop_id = partition.stop_ids[stop];
+        reachable.push_back({stop_id, std::string(snapshot.stops.at(stop_id)->name), arrival, legs,
+                             (budget_seconds - (arrival - start)) * WALKING_SPEED});
+    }
+
+    std::sort(reachable.begin(), reachable.end(), [](const IsochroneStop &a, const IsochroneStop &b) {
+        return a.arrival_time < b.arrival_time;
+    });
+    return reachable;
+}
+
+std::vector<IsochroneStop> compute_isochrone_from_address(const TimetableSnapshot &snapshot, const std::string &address, const std::string &date, const std::string &start_time, int32_t budget_seconds) {
+    Coordinates start_coords = getCoordinates(address);
+    return compute_isochrone(snapshot, start_coords, date, start_time, budget_seconds);
+}
@@ -0,0 +1,29 @@
+#ifndef ISOCHRONE_H
+#define ISOCHRONE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "sequence.h"
+#include "raptor.h"
+
+struct TimetableSnapshot;
+
+// A stop reachable within the time budget
+struct IsochroneStop {
+    int32_t stop_id;
+    std::string name;
+    int32_t arrival_time; // seconds since midnight
+    int legs;             // rides needed, 0 for stops reached on foot from the start
+    double fringe_meters; // how far one can still walk from the stop with the remaining budget
+};
+
+// Function to find every stop reachable from a location within budget_seconds of start_time,
+// earliest first. The search starts from the nearest stops (walking there counts against the
+// budget) and runs one one-to-all RAPTOR pass cut off at the budget.
+std::vector<IsochroneStop> compute_isochrone(const TimetableSnapshot &snapshot, Coordinates start_coords, const std::string &date, const std::string &start_time, int32_t budget_seconds, const RaptorOptions &options = RaptorOptions());
+
+// Function to geocode an address like getCoordinates and compute its isochrone
+std::vector<IsochroneStop> compute_isochrone_from_address(const TimetableSnapshot &snapshot, const std::string &address, const std::string &date, const std::string &start_time, int32_t budget_seconds);
+
+#endif // ISOCHRONE_H
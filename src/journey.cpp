@@ -0,0 +1,56 @@
+#include "journey.h"
+#include <algorithm>
+#include <stdexcept>
+#include "snapshot.h"
+#include "calendar.h"
+
+std::vector<StopAccess> nearest_stop_access(const TimetableSnapshot &snapshot, Coordinates location, int size_of_response) {
+    std::vector<StopAccess> access;
+    for (const BusStop &stop : snapshot.stop_index->nearest(location.latitude, location.longitude, size_of_response)) {
+        access.push_back({std::stoi(stop.id), 0});
+    }
+    return access;
+}
+
+std::vector<StopAccess> candidate_stop_access(const TimetableSnapshot &snapshot, Coordinates location, const CandidateOptions &options) {
+    std::vector<StopAccess> access;
+    for (const BusStop &stop : snapshot.stop_index->candidates(location.latitude, location.longitude, options)) {
+        access.push_back({std::stoi(stop.id), walking_seconds(stop.distance)});
+    }
+    return access;
+}
+
+// Function to fill the fields shared by Solution and SolutionTwoBuses from one leg
+template <typename T>
+static void describe_leg(const TimetableSnapshot &snapshot, const JourneyLeg &leg, T &solution) {
+    const LineTimetable &line = *snapshot.lines.at(leg.line_id);
+    solution.bus_line = std::string(line.name);
+    solution.direction = std::string(line.direction);
+    solution.departure_time = format_time_of_day(leg.departure_time);
+    solution.arrival_time = format_time_of_day(leg.arrival_time);
+    solution.start_stop = std::string(snapshot.stops.at(leg.from_stop_id)->name);
+    solution.goal_stop = std::string(snapshot.stops.at(leg.to_stop_id)->name);
+}
+
+std::variant<Solution, SolutionTwoBuses> journey_to_solution(const TimetableSnapshot &snapshot, const Journey &journey) {
+    if (journey.legs.size() == 1) {
+        Solution solution;
+        describe_leg(snapshot, journey.legs[0], solution);
+        return solution;
+    }
+    if (journey.legs.size() != 2) {
+        throw std::runtime_error("Journey does not fit the find_routes answer format");
+    }
+
+    SolutionTwoBuses solution;
+    describe_leg(snapshot, journey.legs[0], solution);
+    Solution second;
+    describe_leg(snapshot, journey.legs[1], second);
+    solution.second_bus_line = second.bus_line;
+    solution.second_direction = second.direction;
+    solution.second_departure_time = second.departure_time;
+    solution.second_arrival_time = second.arrival_time;
+    solution.second_start_stop = second.start_stop;
+    solution.second_goal_stop = second.goal_stop;
+    return solution;
+}
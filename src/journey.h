@@ -0,0 +1,55 @@
+#ifndef JOURNEY_H
+#define JOURNEY_H
+
+#include <cstdint>
+#include <string>
+#include <variant>
+#include <vector>
+#include "sequence.h"
+#include "nearest_stops.h"
+
+struct TimetableSnapshot;
+
+// A stop where an in-memory search starts or ends, with the time it takes to walk
+// between the stop and the address
+struct StopAccess {
+    int32_t stop_id;
+    int32_t walk_seconds = 0;
+};
+
+// One ride on one trip; times are seconds since midnight
+struct JourneyLeg {
+    int32_t line_id;
+    int32_t trip_ordinal; // departure_ordinal_number
+    int32_t from_stop_id;
+    int32_t to_stop_id;
+    int32_t departure_time;
+    int32_t arrival_time;
+};
+
+struct Journey {
+    int32_t departure_time; // leaving the origin address
+    int32_t arrival_time;   // reaching the goal address
+    std::vector<JourneyLeg> legs;
+};
+
+// Average walking speed used to turn distances into walking times
+const double WALKING_SPEED = 1.3; // meters per second
+
+inline int32_t walking_seconds(double meters) {
+    return static_cast<int32_t>(meters / WALKING_SPEED + 0.5);
+}
+
+// Function to pick the size_of_response stops nearest to a location over the snapshot.
+// Walking time is left at zero, as in the SQL routers.
+std::vector<StopAccess> nearest_stop_access(const TimetableSnapshot &snapshot, Coordinates location, int size_of_response);
+
+// Function to pick the stops worth walking to from a location (see CandidateOptions), each
+// with its walking time, so a far stop only wins if its buses make up for the walk
+std::vector<StopAccess> candidate_stop_access(const TimetableSnapshot &snapshot, Coordinates location, const CandidateOptions &options = CandidateOptions());
+
+// Function to turn a one- or two-leg journey into the answer format of find_routes;
+// throws std::runtime_error for journeys with more legs
+std::variant<Solution, SolutionTwoBuses> journey_to_solution(const TimetableSnapshot &snapshot, const Journey &journey);
+
+#endif // JOURNEY_H
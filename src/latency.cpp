@@ -0,0 +1,163 @@
+#include "latency.h"
+#include <iomanip>
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+// Function to map a latency to its log-linear bucket
+int LatencyHistogram::bucket_index(uint64_t nanoseconds) {
+    if (nanoseconds < SUB_BUCKET_COUNT) {
+        return static_cast<int>(nanoseconds);
+    }
+
+    int magnitude = 63 - __builtin_clzll(nanoseconds);
+    if (magnitude > MAX_MAGNITUDE) {
+        return BUCKET_COUNT - 1;
+    }
+
+    int shift = magnitude - SUB_BUCKET_BITS;
+    int mantissa = static_cast<int>(nanoseconds >> shift); // in [SUB_BUCKET_COUNT, 2 * SUB_BUCKET_COUNT)
+    return shift * SUB_BUCKET_COUNT + mantissa;
+}
+
+// Function to get the largest latency that still falls into a bucket
+uint64_t LatencyHistogram::bucket_upper_bound(int index) {
+    if (index < 2 * SUB_BUCKET_COUNT) {
+        return static_cast<uint64_t>(index);
+    }
+
+    int shift = index / SUB_BUCKET_COUNT - 1;
+    uint64_t mantissa = static_cast<uint64_t>(index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT);
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+    buckets[bucket_index(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    total_count.fetch_add(1, std::memory_order_relaxed);
+    total_sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+    uint64_t current_max = max_value.load(std::memory_order_relaxed);
+    while (nanoseconds > current_max &&
+           !max_value.compare_exchange_weak(current_max, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+// Function to add the samples of another histogram (e.g. a per-thread one) into this one
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        uint64_t value = other.buckets[i].load(std::memory_order_relaxed);
+        if (value != 0) {
+            buckets[i].fetch_add(value, std::memory_order_relaxed);
+        }
+    }
+    total_count.fetch_add(other.total_count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    total_sum.fetch_add(other.total_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    uint64_t other_max = other.max_value.load(std::memory_order_relaxed);
+    uint64_t current_max = max_value.load(std::memory_order_relaxed);
+    while (other_max > current_max &&
+           !max_value.compare_exchange_weak(current_max, other_max, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (auto &bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    total_count.store(0, std::memory_order_relaxed);
+    total_sum.store(0, std::memory_order_relaxed);
+    max_value.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const {
+    return total_count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::max() const {
+    return max_value.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const {
+    uint64_t samples = count();
+    if (samples == 0) {
+        return 0.0;
+    }
+    return static_cast<double>(total_sum.load(std::memory_order_relaxed)) / samples;
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const {
+    uint64_t samples = count();
+    if (samples == 0) {
+        return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(fraction * samples + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t upper = bucket_upper_bound(i);
+            return upper < max() ? upper : max();
+        }
+    }
+    return max();
+}
+
+LatencyHistogram &latency_histogram(LatencyEndpoint endpoint) {
+    static LatencyHistogram histograms[static_cast<int>(LatencyEndpoint::Count)];
+    return histograms[static_cast<int>(endpoint)];
+}
+
+const char *latency_endpoint_name(LatencyEndpoint endpoint) {
+    switch (endpoint) {
+        case LatencyEndpoint::FindRoutes: return "find_routes";
+        case LatencyEndpoint::FindRoutesOpenmp: return "find_routes_openmp";
+        case LatencyEndpoint::FindRoutesBatched: return "find_routes_batched";
+        case LatencyEndpoint::FindRoutesRaptor: return "find_routes_raptor";
+        case LatencyEndpoint::FindRoutesProfile: return "find_routes_profile";
+        case LatencyEndpoint::FindRoutesArriveBy: return "find_routes_arrive_by";
+        case LatencyEndpoint::FindRoutesTripBased: return "find_routes_trip_based";
+        case LatencyEndpoint::FindRoutesTransferPatterns: return "find_routes_transfer_patterns";
+        case LatencyEndpoint::Isochrone: return "isochrone";
+        case LatencyEndpoint::Geocode: return "geocode";
+        case LatencyEndpoint::Sql: return "sql";
+        case LatencyEndpoint::SqlPipeline: return "sql_pipeline";
+        default: return "unknown";
+    }
+}
+
+void dump_latency_histogram(std::ostream &out, const char *name, const LatencyHistogram &histogram) {
+    auto ms = [](double nanoseconds) { return nanoseconds / 1e6; };
+
+    out << std::left << std::setw(20) << name << std::right
+        << " count=" << histogram.count()
+        << std::fixed << std::setprecision(3)
+        << " mean=" << ms(histogram.mean()) << "ms"
+        << " p50=" << ms(histogram.percentile(0.50)) << "ms"
+        << " p90=" << ms(histogram.percentile(0.90)) << "ms"
+        << " p99=" << ms(histogram.percentile(0.99)) << "ms"
+        << " p999=" << ms(histogram.percentile(0.999)) << "ms"
+        << " max=" << ms(histogram.max()) << "ms" << std::endl;
+    out << std::defaultfloat;
+}
+
+void dump_latency_report(std::ostream &out) {
+    for (int i = 0; i < static_cast<int>(LatencyEndpoint::Count); ++i) {
+        auto endpoint = static_cast<LatencyEndpoint>(i);
+        const LatencyHistogram &histogram = latency_histogram(endpoint);
+        if (histogram.count() > 0) {
+            dump_latency_histogram(out, latency_endpoint_name(endpoint), histogram);
+        }
+    }
+}
+
+void reset_latency_histograms() {
+    for (int i = 0; i < static_cast<int>(LatencyEndpoint::Count); ++i) {
+        latency_histogram(static_cast<LatencyEndpoint>(i)).reset();
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Endpoints we keep latency histograms for
+enum class LatencyEndpoint {
+    FindRoutes,
+    FindRoutesOpenmp,
+    FindRoutesBatched,
+    FindRoutesRaptor,
+    FindRoutesProfile,
+    FindRoutesArriveBy,
+    FindRoutesTripBased,
+    FindRoutesTransferPatterns,
+    Isochrone,
+    Geocode,
+    Sql,
+    SqlPipeline, // a whole pipelined batch of queries, retrieved together
+    Count
+};
+
+// HDR-style log-linear histogram of latencies in nanoseconds.
+// Every power of two is split into 32 linear sub-buckets, which keeps the
+// relative error of reported percentiles around 3%. Recording is a single
+// relaxed atomic increment, so one histogram can be shared by all threads.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 5;
+    static constexpr int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static constexpr int MAX_MAGNITUDE = 45; // ~9.7 hours in nanoseconds, larger values are clamped
+    static constexpr int BUCKET_COUNT = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2) * SUB_BUCKET_COUNT;
+
+    LatencyHistogram();
+
+    void record(uint64_t nanoseconds);
+    void merge(const LatencyHistogram &other);
+    void reset();
+
+    uint64_t count() const;
+    uint64_t max() const;
+    double mean() const;
+    // Value (in nanoseconds) below which the given fraction of samples fall, e.g. 0.99 for p99
+    uint64_t percentile(double fraction) const;
+
+    static int bucket_index(uint64_t nanoseconds);
+    static uint64_t bucket_upper_bound(int index);
+
+private:
+    std::atomic<uint64_t> buckets[BUCKET_COUNT];
+    std::atomic<uint64_t> total_count;
+    std::atomic<uint64_t> total_sum;
+    std::atomic<uint64_t> max_value;
+};
+
+LatencyHistogram &latency_histogram(LatencyEndpoint endpoint);
+const char *latency_endpoint_name(LatencyEndpoint endpoint);
+
+// Print count, mean and p50/p90/p99/p999/max for every endpoint that has samples
+void dump_latency_histogram(std::ostream &out, const char *name, const LatencyHistogram &histogram);
+void dump_latency_report(std::ostream &out);
+void reset_latency_histograms();
+
+// Records the lifetime of the object into a histogram
+class ScopedLatency {
+public:
+    explicit ScopedLatency(LatencyHistogram &histogram)
+        : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+    explicit ScopedLatency(LatencyEndpoint endpoint)
+        : ScopedLatency(latency_histogram(endpoint)) {}
+    ~ScopedLatency() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    ScopedLatency(const ScopedLatency &) = delete;
+    ScopedLatency &operator=(const ScopedLatency &) = delete;
+
+private:
+    LatencyHistogram &histogram;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // LATENCY_H
@@ -0,0 +1,388 @@
+// Load generator replaying a recorded query log against the routing engine.
+//
+// Log format: one query per line, fields separated by '|':
+//     start address|goal address|YYYY-MM-DD|HH:MM
+// Empty lines and lines starting with '#' are skipped.
+//
+// Usage:
+//     loadgen <query log> [--mode sequence|openmp|batched|raptor|profile|arrive-by|trip-based|transfer-patterns]
+//             [--concurrency N] [--rate QPS] [--requests N] [--duration SECONDS] [--window MINUTES]
+//             [--patterns FILE] [--db CONNINFO]
+//
+// profile looks for every departure between the logged time and --window minutes later
+// (60 by default), and arrive-by takes the logged time as the deadline. trip-based builds
+// the index of a day type the first time a query needs it, and again after every reload.
+// transfer-patterns evaluates the --patterns file of build_transfer_patterns; its queries
+// fail once the timetable no longer matches the one the patterns were built from.
+//
+// The raptor, profile, arrive-by, trip-based and transfer-patterns modes answer from an
+// in-memory timetable snapshot, and the batched mode uses one to prune its one-change
+// queries. The snapshot is loaded from the database at startup and kept current by a
+// ChangeListener while the workers run (the change triggers are installed at startup),
+// every query pinning the snapshot that was current when it started. A lost listener
+// connection turns into a full reload.
+//
+// Without --rate the generator runs closed-loop: every worker issues its next
+// query as soon as the previous one finishes. With --rate queries are started
+// on a fixed schedule and latency is measured from the scheduled start, so a
+// stalled engine shows up in the percentiles instead of silently lowering load.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <pqxx/pqxx>
+#include <curl/curl.h>
+#include "sequence.h"
+#include "openmp.h"
+#include "batched.h"
+#include "latency.h"
+#include "snapshot.h"
+#include "raptor.h"
+#include "trip_based.h"
+#include "transfer_patterns.h"
+#include "change_listener.h"
+#include "calendar.h"
+
+struct LoggedQuery {
+    std::string start_location;
+    std::string goal_location;
+    std::string date;
+    std::string time;
+};
+
+struct LoadgenOptions {
+    std::string log_path;
+    std::string mode = "openmp";
+    std::string db = "dbname=ebus2 user=dawid password=Dragon11 host=localhost port=5432";
+    int concurrency = 1;
+    double rate = 0.0;     // queries per second, 0 means closed-loop
+    long requests = 0;     // 0 means one pass over the log (or until --duration)
+    double duration = 0.0; // seconds, 0 means no time limit
+    int window = 60;       // minutes, profile mode
+    std::string patterns_path;
+};
+
+// Function to read the recorded queries from the log file
+std::vector<LoggedQuery> read_query_log(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to open query log: " + path);
+    }
+
+    std::vector<LoggedQuery> queries;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::vector<std::string> fields;
+        std::istringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, '|')) {
+            fields.push_back(field);
+        }
+
+        if (fields.size() != 4) {
+            std::cerr << "Skipping malformed line " << line_number << " in " << path << std::endl;
+            continue;
+        }
+
+        queries.push_back({fields[0], fields[1], fields[2], fields[3]});
+    }
+
+    return queries;
+}
+
+// Function to tell the modes served from a timetable snapshot from the SQL ones
+bool is_snapshot_mode(const std::string &mode) {
+    return mode == "raptor" || mode == "profile" || mode == "arrive-by" || mode == "trip-based" || mode == "transfer-patterns";
+}
+
+// Function to tell whether a mode needs a timetable snapshot at all
+bool uses_snapshot(const std::string &mode) {
+    return is_snapshot_mode(mode) || mode == "batched";
+}
+
+LoadgenOptions parse_options(int argc, char **argv) {
+    if (argc < 2) {
+        throw std::runtime_error("Usage: loadgen <query log> [--mode sequence|openmp|batched|raptor|profile|arrive-by|trip-based|transfer-patterns] "
+                                 "[--concurrency N] [--rate QPS] [--requests N] [--duration SECONDS] [--window MINUTES] [--patterns FILE] [--db CONNINFO]");
+    }
+
+    LoadgenOptions options;
+    options.log_path = argv[1];
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + arg);
+        }
+        std::string value = argv[++i];
+
+        if (arg == "--mode") {
+            options.mode = value;
+        } else if (arg == "--concurrency") {
+            options.concurrency = std::stoi(value);
+        } else if (arg == "--rate") {
+            options.rate = std::stod(value);
+        } else if (arg == "--requests") {
+            options.requests = std::stol(value);
+        } else if (arg == "--duration") {
+            options.duration = std::stod(value);
+        } else if (arg == "--window") {
+            options.window = std::stoi(value);
+        } else if (arg == "--patterns") {
+            options.patterns_path = value;
+        } else if (arg == "--db") {
+            options.db = value;
+        } else {
+            throw std::runtime_error("Unknown option " + arg);
+        }
+    }
+
+    if (options.mode != "sequence" && options.mode != "openmp" && options.mode != "batched" && !is_snapshot_mode(options.mode)) {
+        throw std::runtime_error("Unknown mode " + options.mode);
+    }
+    if (options.mode == "transfer-patterns" && options.patterns_path.empty()) {
+        throw std::runtime_error("transfer-patterns needs --patterns");
+    }
+    if (options.concurrency < 1) {
+        options.concurrency = 1;
+    }
+
+    return options;
+}
+
+// Trip-based indexes of the latest snapshot pinned so far, one per day type, built when a
+// query first needs one. A worker still on an older snapshot gets an index of its own.
+class TripBasedIndexes {
+public:
+    std::shared_ptr<const TripBasedIndex> get(const TimetableSnapshot &snapshot, DayType day_type) {
+        std::shared_ptr<const DayPartition> partition = snapshot.partitions[static_cast<int>(day_type)];
+        std::lock_guard<std::mutex> lock(mutex);
+        if (snapshot.version < version) {
+            return build_trip_based_index(partition);
+        }
+        if (snapshot.version > version) {
+            version = snapshot.version;
+            for (auto &index : indexes) {
+                index.reset();
+            }
+        }
+        // Built under the lock: the other workers would need the same index anyway
+        std::shared_ptr<const TripBasedIndex> &index = indexes[static_cast<int>(day_type)];
+        if (!index) {
+            index = build_trip_based_index(partition);
+        }
+        return index;
+    }
+
+private:
+    std::mutex mutex;
+    uint64_t version = 0;
+    std::shared_ptr<const TripBasedIndex> indexes[DAY_TYPE_COUNT];
+};
+
+// Function to run one logged query through the same path main.cpp uses
+size_t run_query(pqxx::connection *conn, const TimetableStore *store, TripBasedIndexes &trip_based_indexes, const TransferPatterns &transfer_patterns, const LoggedQuery &query, const LoadgenOptions &options) {
+    const std::string &mode = options.mode;
+    if (mode == "sequence") {
+        return find_routes(*conn, query.start_location, query.goal_location, query.date, query.time).size();
+    }
+
+    Coordinates start_coords = getCoordinates(query.start_location);
+    Coordinates goal_coords = getCoordinates(query.goal_location);
+    if (is_snapshot_mode(mode)) {
+        // A reload published mid-query does not disturb this one
+        std::shared_ptr<const TimetableSnapshot> snapshot = store->pin();
+        if (mode == "profile") {
+            std::string window_end = format_time_of_day(parse_time_of_day(query.time) + options.window * 60);
+            return find_routes_profile(*snapshot, start_coords, goal_coords, query.date, query.time, window_end).size();
+        }
+        if (mode == "arrive-by") {
+            return find_routes_arrive_by(*snapshot, start_coords, goal_coords, query.date, query.time).size();
+        }
+        if (mode == "trip-based") {
+            std::shared_ptr<const TripBasedIndex> index = trip_based_indexes.get(*snapshot, day_type_for_date(query.date));
+            return find_routes_trip_based(*snapshot, *index, start_coords, goal_coords, query.date, query.time).size();
+        }
+        if (mode == "transfer-patterns") {
+            return find_routes_transfer_patterns(*snapshot, transfer_patterns, start_coords, goal_coords, query.date, query.time).size();
+        }
+        return find_routes_raptor(*snapshot, start_coords, goal_coords, query.date, query.time).size();
+    }
+    if (mode == "batched") {
+        return find_routes_batched(*conn, query.date, query.time, start_coords, goal_coords, store->pin()).size();
+    }
+    return find_routes_openmp(*conn, query.date, query.time, start_coords, goal_coords).size();
+}
+
+int main(int argc, char **argv) {
+    try {
+        LoadgenOptions options = parse_options(argc, argv);
+        std::vector<LoggedQuery> queries = read_query_log(options.log_path);
+        if (queries.empty()) {
+            std::cerr << "Query log is empty" << std::endl;
+            return 1;
+        }
+
+        // Workers geocode through curl_easy_init, which is only thread-safe after this
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+
+        std::unique_ptr<TimetableStore> store;
+        if (uses_snapshot(options.mode)) {
+            // Each load opens its own connection, so a reload after a dropped connection still works
+            std::string db = options.db;
+            store = std::make_unique<TimetableStore>(
+                [db]() {
+                    pqxx::connection conn(db);
+                    return load_timetable(conn);
+                },
+                [db](const ChangeSet &changes) {
+                    pqxx::connection conn(db);
+                    return load_timetable_changes(conn, changes);
+                });
+        }
+
+        TripBasedIndexes trip_based_indexes;
+        TransferPatterns transfer_patterns;
+        if (!options.patterns_path.empty()) {
+            transfer_patterns = read_transfer_patterns(options.patterns_path);
+        }
+
+        // Rows changed between the first load and the listener's LISTEN wait for the next full reload
+        std::unique_ptr<ChangeListener> listener;
+        if (store) {
+            pqxx::connection setup(options.db);
+            install_change_triggers(setup);
+            listener = std::make_unique<ChangeListener>(options.db, [&store](const ChangeSet &changes) {
+                store->apply_changes(changes);
+            });
+        }
+
+        long total_requests = options.requests;
+        if (total_requests == 0 && options.duration == 0.0) {
+            total_requests = static_cast<long>(queries.size());
+        }
+
+        LatencyHistogram latency;
+        std::atomic<long> next_ticket{0};
+        std::atomic<long> completed{0};
+        std::atomic<long> errors{0};
+        std::atomic<long> succeeded{0};
+        std::atomic<long> empty_answers{0};
+        std::mutex error_mutex;
+        std::vector<std::string> error_samples;
+
+        auto start_time = std::chrono::steady_clock::now();
+        auto deadline = start_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                         std::chrono::duration<double>(options.duration));
+
+        std::vector<std::thread> workers;
+        for (int w = 0; w < options.concurrency; ++w) {
+            workers.emplace_back([&]() {
+                std::unique_ptr<pqxx::connection> conn;
+                if (!is_snapshot_mode(options.mode)) {
+                    try {
+                        conn = std::make_unique<pqxx::connection>(options.db);
+                    } catch (const std::exception &e) {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        std::cerr << "Worker failed to connect: " << e.what() << std::endl;
+                        return;
+                    }
+                }
+
+                while (true) {
+                    long ticket = next_ticket.fetch_add(1);
+                    if (total_requests > 0 && ticket >= total_requests) {
+                        break;
+                    }
+
+                    auto scheduled = std::chrono::steady_clock::now();
+                    if (options.rate > 0.0) {
+                        scheduled = start_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                     std::chrono::duration<double>(ticket / options.rate));
+                    }
+                    if (options.duration > 0.0 && scheduled >= deadline) {
+                        break;
+                    }
+                    std::this_thread::sleep_until(scheduled);
+
+                    const LoggedQuery &query = queries[ticket % queries.size()];
+                    try {
+                        if (run_query(conn.get(), store.get(), trip_based_indexes, transfer_patterns, query, options) == 0) {
+                            empty_answers.fetch_add(1);
+                        }
+                        succeeded.fetch_add(1);
+                    } catch (const std::exception &e) {
+                        errors.fetch_add(1);
+                        {
+                            std::lock_guard<std::mutex> lock(error_mutex);
+                            if (error_samples.size() < 10) {
+                                error_samples.push_back(e.what());
+                            }
+                        }
+                        // Reconnect outside the lock, so one slow reconnect does not hold up the other workers
+                        if (conn && !conn->is_open()) {
+                            try {
+                                conn = std::make_unique<pqxx::connection>(options.db);
+                            } catch (const std::exception &) {
+                            }
+                        }
+                    }
+
+                    auto elapsed = std::chrono::steady_clock::now() - scheduled;
+                    latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+                    completed.fetch_add(1);
+                }
+            });
+        }
+
+        for (auto &worker : workers) {
+            worker.join();
+        }
+
+        std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - start_time;
+
+        std::cout << "Mode: " << options.mode
+                  << ", concurrency: " << options.concurrency
+                  << ", target rate: " << (options.rate > 0.0 ? std::to_string(options.rate) + " qps" : "closed-loop")
+                  << std::endl;
+        std::cout << "Completed: " << completed.load()
+                  << ", errors: " << errors.load()
+                  << ", empty answers: " << empty_answers.load()
+                  << ", wall time: " << wall_time.count() << " s"
+                  << ", throughput: " << completed.load() / wall_time.count() << " qps" << std::endl;
+        if (store) {
+            std::cout << "Snapshot version: " << store->pin()->version
+                      << ", failed reloads: " << store->failed_reloads() << std::endl;
+        }
+
+        dump_latency_histogram(std::cout, "query", latency);
+        dump_latency_report(std::cout);
+
+        for (const auto &sample : error_samples) {
+            std::cout << "Error: " << sample << std::endl;
+        }
+        curl_global_cleanup();
+
+        if (succeeded.load() == 0) {
+            std::cerr << "No query succeeded" << std::endl;
+            return 1;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
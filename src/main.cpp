@@ -2,6 +2,13 @@
 #include <chrono>
 #include "sequence.h"
 #include "openmp.h"
+#include "batched.h"
+#include "latency.h"
+#include "snapshot.h"
+#include "raptor.h"
+#include "trip_based.h"
+#include "transfer_patterns.h"
+#include "calendar.h"
 #include <iostream>
 #include <pqxx/pqxx> // Include libpqxx headers
 #include <vector>
@@ -9,8 +16,26 @@
 #include <string>
 #include <fstream> // Include the fstream header
 
-int main() {
+// Usage: rownolegle [sequence|openmp|batched|raptor|profile|arrive-by|trip-based] [timetable file], openmp by default.
+//        rownolegle transfer-patterns <timetable file> <transfer patterns file>
+// raptor, profile, arrive-by and trip-based search an in-memory snapshot of the timetable
+// file written by build_timetable, or of the database when no file is given; batched uses
+// the file, if given, to prune its one-change queries. transfer-patterns evaluates patterns
+// written by build_transfer_patterns from the same timetable file, for the date's day type.
+int main(int argc, char **argv) {
     try {
+        std::string mode = argc > 1 ? argv[1] : "openmp";
+        bool snapshot_mode = mode == "raptor" || mode == "profile" || mode == "arrive-by" || mode == "trip-based" || mode == "transfer-patterns";
+        if (mode != "sequence" && mode != "openmp" && mode != "batched" && !snapshot_mode) {
+            std::cerr << "Unknown mode " << mode << ", expected sequence, openmp, batched, raptor, profile, arrive-by, trip-based or transfer-patterns" << std::endl;
+            return 1;
+        }
+        std::string timetable_path = argc > 2 ? argv[2] : "";
+        if (mode == "transfer-patterns" && argc < 4) {
+            std::cerr << "Usage: rownolegle transfer-patterns <timetable file> <transfer patterns file>" << std::endl;
+            return 1;
+        }
+
         pqxx::connection conn("dbname=ebus2 user=dawid password=Dragon11 host=localhost port=5432");
         if (conn.is_open()) {
             std::cout << "Connected to database successfully!" << std::endl;
@@ -23,23 +48,56 @@ int main() {
         std::string goal_location = "Piaski Szczygliczka, Ostrów Wielkopolski";  
         std::string date = "2024-05-30";                   
         std::string time = "12:00";                        
+        std::string window_end = "13:00";  // profile: departures between time and window_end
+        std::string deadline = "14:00";    // arrive-by
+
+        std::shared_ptr<const TimetableSnapshot> snapshot;
+        if (!timetable_path.empty()) {
+            snapshot = make_snapshot(open_timetable_file(timetable_path), 1);
+        } else if (snapshot_mode) {
+            snapshot = make_snapshot(load_timetable(conn), 1);
+        }
+        // Preprocessing, like loading the snapshot, is not part of the measured query
+        std::shared_ptr<const TripBasedIndex> trip_based_index;
+        if (mode == "trip-based") {
+            trip_based_index = build_trip_based_index(snapshot->partitions[static_cast<int>(day_type_for_date(date))]);
+        }
+        TransferPatterns transfer_patterns;
+        if (mode == "transfer-patterns") {
+            transfer_patterns = read_transfer_patterns(argv[3]);
+        }
         auto start_time = std::chrono::high_resolution_clock::now();
 
-        Coordinates start_coords = getCoordinates(start_location);
-        Coordinates goal_coords = getCoordinates(goal_location);
-
-
-        //auto solutions = find_routes(conn, start_location, goal_location, date, time);
-
-        auto solutions = find_routes_openmp(conn, start_location, goal_location, date, time, start_coords, goal_coords);
+        std::vector<std::variant<Solution, SolutionTwoBuses>> solutions;
+        if (mode == "sequence") {
+            solutions = find_routes(conn, start_location, goal_location, date, time);
+        } else {
+            Coordinates start_coords = getCoordinates(start_location);
+            Coordinates goal_coords = getCoordinates(goal_location);
+            if (mode == "raptor") {
+                solutions = find_routes_raptor(*snapshot, start_coords, goal_coords, date, time);
+            } else if (mode == "profile") {
+                solutions = find_routes_profile(*snapshot, start_coords, goal_coords, date, time, window_end);
+            } else if (mode == "arrive-by") {
+                solutions = find_routes_arrive_by(*snapshot, start_coords, goal_coords, date, deadline);
+            } else if (mode == "trip-based") {
+                solutions = find_routes_trip_based(*snapshot, *trip_based_index, start_coords, goal_coords, date, time);
+            } else if (mode == "transfer-patterns") {
+                solutions = find_routes_transfer_patterns(*snapshot, transfer_patterns, start_coords, goal_coords, date, time);
+            } else if (mode == "batched") {
+                solutions = find_routes_batched(conn, date, time, start_coords, goal_coords, snapshot);
+            } else {
+                solutions = find_routes_openmp(conn, date, time, start_coords, goal_coords);
+            }
+        }
 
         auto end_time = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> elapsed_time = end_time - start_time;
 
-        std::cout << "Execution time for squence algorithm: " << elapsed_time.count() << " seconds" << std::endl;
+        std::cout << "Execution time for " << mode << " algorithm: " << elapsed_time.count() << " seconds" << std::endl;
 
 
-        std::ofstream file("solutions_openmp.txt");
+        std::ofstream file("solutions_" + mode + ".txt");
         if (!file) {
             std::cerr << "Error opening file for writing." << std::endl;
             return 1;
@@ -78,6 +136,8 @@ int main() {
 
         file.close();
 
+        dump_latency_report(std::cout);
+
 
 
 
@@ -0,0 +1,130 @@
+#include "matrix.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+TravelTimeMatrix compute_travel_time_matrix(const DayPartition &partition, std::vector<int32_t> source_stop_ids, std::vector<int32_t> target_stop_ids, int32_t departure_time, const RaptorOptions &options) {
+    TravelTimeMatrix matrix;
+    matrix.day_type = partition.day_type;
+    matrix.departure_time = departure_time;
+    matrix.max_legs = options.max_legs;
+    matrix.source_stop_ids = source_stop_ids.empty() ? partition.stop_ids : std::move(source_stop_ids);
+    matrix.target_stop_ids = target_stop_ids.empty() ? partition.stop_ids : std::move(target_stop_ids);
+
+    size_t target_count = matrix.target_stop_ids.size();
+    matrix.seconds.assign(matrix.source_stop_ids.size() * target_count, MATRIX_UNREACHED);
+
+    // Dense stop index of every target, -1 for stops the partition does not serve
+    std::vector<int> target_index(target_count);
+    for (size_t t = 0; t < target_count; ++t) {
+        target_index[t] = partition.stop_index(matrix.target_stop_ids[t]);
+    }
+
+    RaptorOptions forwards = options;
+    forwards.arrive_by = false;
+
+    #pragma omp parallel
+    {
+        // Rows are independent: every thread reuses one search and writes only its own rows
+        RaptorSearch search(partition, forwards);
+
+        #pragma omp for schedule(dynamic)
+        for (size_t s = 0; s < matrix.source_stop_ids.size(); ++s) {
+            if (partition.stop_index(matrix.source_stop_ids[s]) < 0) {
+                continue;
+            }
+            search.reset();
+            search.run({{matrix.source_stop_ids[s], 0}}, departure_time);
+
+            uint16_t *row = matrix.seconds.data() + s * target_count;
+            for (size_t t = 0; t < target_count; ++t) {
+                if (target_index[t] < 0) {
+                    continue;
+                }
+                int32_t arrival = search.best_time(static_cast<uint32_t>(target_index[t]), forwards.max_legs);
+                if (arrival != RAPTOR_UNREACHED && arrival - departure_time < MATRIX_UNREACHED) {
+                    row[t] = static_cast<uint16_t>(arrival - departure_time);
+                }
+            }
+        }
+    }
+
+    return matrix;
+}
+
+void write_travel_time_matrix(const TravelTimeMatrix &matrix, const std::string &path) {
+    // Written under a temporary name and renamed, like write_timetable_file
+    std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Failed to open " + temporary_path + " for writing");
+        }
+        uint8_t day_type = static_cast<uint8_t>(matrix.day_type);
+        int32_t max_legs = matrix.max_legs;
+        uint32_t source_count = static_cast<uint32_t>(matrix.source_stop_ids.size());
+        uint32_t target_count = static_cast<uint32_t>(matrix.target_stop_ids.size());
+        file.write(TRAVEL_TIME_MATRIX_MAGIC, sizeof(TRAVEL_TIME_MATRIX_MAGIC));
+        file.write(reinterpret_cast<const char *>(&day_type), sizeof(day_type));
+        file.write(reinterpret_cast<const char *>(&matrix.departure_time), sizeof(matrix.departure_time));
+        file.write(reinterpret_cast<const char *>(&max_legs), sizeof(max_legs));
+        file.write(reinterpret_cast<const char *>(&source_count), sizeof(source_count));
+        file.write(reinterpret_cast<const char *>(&target_count), sizeof(target_count));
+        file.write(reinterpret_cast<const char *>(matrix.source_stop_ids.data()), source_count * sizeof(int32_t));
+        file.write(reinterpret_cast<const char *>(matrix.target_stop_ids.data()), target_count * sizeof(int32_t));
+        file.write(reinterpret_cast<const char *>(matrix.seconds.data()), static_cast<std::streamsize>(matrix.seconds.size() * sizeof(uint16_t)));
+        if (!file) {
+            throw std::runtime_error("Failed to write " + temporary_path);
+        }
+    }
+
+    if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Failed to rename " + temporary_path + " to " + path);
+    }
+}
+
+TravelTimeMatrix read_travel_time_matrix(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open travel time matrix " + path);
+    }
+    file.seekg(0, std::ios::end);
+    uint64_t file_size = static_cast<uint64_t>(file.tellg());
+    file.seekg(0, std::ios::beg);
+
+    char magic[sizeof(TRAVEL_TIME_MATRIX_MAGIC)];
+    uint8_t day_type = 0;
+    int32_t max_legs = 0;
+    uint32_t source_count = 0;
+    uint32_t target_count = 0;
+    TravelTimeMatrix matrix;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(&day_type), sizeof(day_type));
+    file.read(reinterpret_cast<char *>(&matrix.departure_time), sizeof(matrix.departure_time));
+    file.read(reinterpret_cast<char *>(&max_legs), sizeof(max_legs));
+    file.read(reinterpret_cast<char *>(&source_count), sizeof(source_count));
+    file.read(reinterpret_cast<char *>(&target_count), sizeof(target_count));
+    if (!file || !std::equal(magic, magic + sizeof(magic), TRAVEL_TIME_MATRIX_MAGIC) || day_type >= DAY_TYPE_COUNT || max_legs < 1) {
+        throw std::runtime_error("Not a travel time matrix: " + path);
+    }
+    matrix.day_type = static_cast<DayType>(day_type);
+    matrix.max_legs = max_legs;
+
+    // A corrupt header must not turn into a huge allocation before the reads fail
+    uint64_t remaining = file_size - static_cast<uint64_t>(file.tellg());
+    uint64_t id_bytes = (static_cast<uint64_t>(source_count) + target_count) * sizeof(int32_t);
+    if (id_bytes > remaining || static_cast<uint64_t>(source_count) * target_count > (remaining - id_bytes) / sizeof(uint16_t)) {
+        throw std::runtime_error("Truncated travel time matrix " + path);
+    }
+
+    matrix.source_stop_ids.resize(source_count);
+    matrix.target_stop_ids.resize(target_count);
+    matrix.seconds.resize(static_cast<size_t>(source_count) * target_count);
+    file.read(reinterpret_cast<char *>(matrix.source_stop_ids.data()), source_count * sizeof(int32_t));
+    file.read(reinterpret_cast<char *>(matrix.target_stop_ids.data()), target_count * sizeof(int32_t));
+    file.read(reinterpret_cast<char *>(matrix.seconds.data()), static_cast<std::streamsize>(matrix.seconds.size() * sizeof(uint16_t)));
+    if (!file) {
+        throw std::runtime_error("Truncated travel time matrix " + path);
+    }
+    return matrix;
+}
@@ -0,0 +1,39 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include "partition.h"
+#include "raptor.h"
+
+const char TRAVEL_TIME_MATRIX_MAGIC[8] = {'J', 'D', 'T', 'T', 'M', 'X', '0', '2'};
+const uint16_t MATRIX_UNREACHED = std::numeric_limits<uint16_t>::max();
+const int MATRIX_DEFAULT_MAX_LEGS = 4; // up to three changes
+
+// Earliest-arrival travel times between stops for one departure time, in seconds from the
+// departure time to the arrival, row-major by source. Travel times that do not fit into
+// 16 bits (over about 18 hours) and unreachable pairs are MATRIX_UNREACHED. Only journeys
+// of at most max_legs rides count, so pairs that need more changes are MATRIX_UNREACHED too.
+struct TravelTimeMatrix {
+    DayType day_type = DayType::Working;
+    int32_t departure_time = 0;
+    int max_legs = 0;
+    std::vector<int32_t> source_stop_ids;
+    std::vector<int32_t> target_stop_ids;
+    std::vector<uint16_t> seconds;
+
+    uint16_t at(size_t source, size_t target) const { return seconds[source * target_stop_ids.size() + target]; }
+};
+
+// Function to run one one-to-all search per source over the partition, spread over the
+// OpenMP threads; empty source or target lists mean every stop of the partition
+TravelTimeMatrix compute_travel_time_matrix(const DayPartition &partition, std::vector<int32_t> source_stop_ids, std::vector<int32_t> target_stop_ids, int32_t departure_time, const RaptorOptions &options = RaptorOptions());
+
+// File layout: magic, uint8 day type, int32 departure time, int32 max legs, uint32 source and target counts,
+// the source and target stop ids (int32) and the matrix (uint16), all in host byte order
+void write_travel_time_matrix(const TravelTimeMatrix &matrix, const std::string &path);
+TravelTimeMatrix read_travel_time_matrix(const std::string &path);
+
+#endif // MATRIX_H
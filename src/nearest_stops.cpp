@@ -0,0 +1,237 @@
+#include "nearest_stops.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include "database_queries.h"
+#include "snapshot.h"
+
+static const uint32_t LEAF_SIZE = 8;
+
+// Function to map a location to a point on the unit sphere
+static void unit_vector(double latitude, double longitude, double *point) {
+    double phi = latitude * M_PI / 180.0;
+    double lambda = longitude * M_PI / 180.0;
+    point[0] = std::cos(phi) * std::cos(lambda);
+    point[1] = std::cos(phi) * std::sin(lambda);
+    point[2] = std::sin(phi);
+}
+
+StopIndex::StopIndex(std::vector<BusStop> stops) : stops(std::move(stops)) {
+    // Points by stop while building, then rearranged into tree order
+    points.resize(this->stops.size() * 3);
+    order.resize(this->stops.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        unit_vector(this->stops[i].latitude, this->stops[i].longitude, &points[i * 3]);
+        order[i] = i;
+    }
+    if (!order.empty()) {
+        build(0, 0, static_cast<uint32_t>(order.size()));
+    }
+
+    std::vector<double> ordered_points(points.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        std::copy(&points[order[i] * 3], &points[order[i] * 3] + 3, &ordered_points[i * 3]);
+    }
+    points = std::move(ordered_points);
+}
+
+// Function to split a range of stops at the median of its widest axis, recursively
+void StopIndex::build(uint32_t node, uint32_t first, uint32_t last) {
+    if (nodes.size() <= node) {
+        nodes.resize(node + 1, Node{0, 0, 3, 0.0});
+    }
+    nodes[node] = {first, last, 3, 0.0};
+    if (last - first <= LEAF_SIZE) {
+        return;
+    }
+
+    double low[3] = {2.0, 2.0, 2.0};
+    double high[3] = {-2.0, -2.0, -2.0};
+    for (uint32_t i = first; i < last; ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+            low[axis] = std::min(low[axis], points[order[i] * 3 + axis]);
+            high[axis] = std::max(high[axis], points[order[i] * 3 + axis]);
+        }
+    }
+    uint8_t axis = 0;
+    for (uint8_t a = 1; a < 3; ++a) {
+        if (high[a] - low[a] > high[axis] - low[axis]) {
+            axis = a;
+        }
+    }
+
+    uint32_t middle = first + (last - first) / 2;
+    std::nth_element(order.begin() + first, order.begin() + middle, order.begin() + last,
+                     [&](uint32_t a, uint32_t b) { return points[a * 3 + axis] < points[b * 3 + axis]; });
+
+    nodes[node].axis = axis;
+    nodes[node].split = points[order[middle] * 3 + axis];
+    build(2 * node + 1, first, middle);
+    build(2 * node + 2, middle, last);
+}
+
+std::vector<std::pair<double, uint32_t>> StopIndex::search(const double *query, size_t k, double max_distance) const {
+    // Max-heap of the k best (squared chord length, position in order) found so far
+    std::priority_queue<std::pair<double, uint32_t>> best;
+    auto bound = [&]() { return best.size() < k ? max_distance : std::min(max_distance, best.top().first); };
+
+    uint32_t stack[64];
+    int depth = 0;
+    if (k > 0 && !nodes.empty()) {
+        stack[depth++] = 0;
+    }
+    while (depth > 0) {
+        uint32_t index = stack[--depth];
+        const Node &node = nodes[index];
+        if (node.axis == 3) {
+            for (uint32_t i = node.first; i < node.last; ++i) {
+                const double *point = &points[i * 3];
+                double dx = point[0] - query[0], dy = point[1] - query[1], dz = point[2] - query[2];
+                double distance = dx * dx + dy * dy + dz * dz;
+                if (distance < bound()) {
+                    best.push({distance, i});
+                    if (best.size() > k) {
+                        best.pop();
+                    }
+                }
+            }
+            continue;
+        }
+
+        // Visit the near side first (pushed last); the far side only if the split plane is within reach
+        double offset = query[node.axis] - node.split;
+        uint32_t near_child = offset < 0 ? 2 * index + 1 : 2 * index + 2;
+        uint32_t far_child = offset < 0 ? 2 * index + 2 : 2 * index + 1;
+        if (offset * offset <= bound()) {
+            stack[depth++] = far_child;
+        }
+        stack[depth++] = near_child;
+    }
+
+    std::vector<std::pair<double, uint32_t>> found(best.size());
+    for (size_t i = best.size(); i-- > 0; best.pop()) {
+        found[i] = best.top();
+    }
+    return found;
+}
+
+std::vector<BusStop> StopIndex::to_stops(double latitude, double longitude, const std::vector<std::pair<double, uint32_t>> &found) const {
+    std::vector<BusStop> result;
+    result.reserve(found.size());
+    for (const auto &entry : found) {
+        result.push_back(stops[order[entry.second]]);
+        result.back().distance = haversine(latitude, longitude, result.back().latitude, result.back().longitude);
+    }
+    // Chord and haversine rounding can disagree for stops at nearly the same distance
+    std::stable_sort(result.begin(), result.end(), [](const BusStop &a, const BusStop &b) {
+        return a.distance < b.distance;
+    });
+    return result;
+}
+
+std::vector<BusStop> StopIndex::nearest(double latitude, double longitude, int size_of_response) const {
+    double query[3];
+    unit_vector(latitude, longitude, query);
+    size_t k = std::min(stops.size(), static_cast<size_t>(std::max(size_of_response, 0)));
+    return to_stops(latitude, longitude, search(query, k, std::numeric_limits<double>::max()));
+}
+
+std::vector<BusStop> StopIndex::candidates(double latitude, double longitude, const CandidateOptions &options) const {
+    double query[3];
+    unit_vector(latitude, longitude, query);
+
+    // A walk of d meters is a chord of 2 sin(d / 2R) on the unit sphere
+    const double R = 6371e3;
+    double chord = 2.0 * std::sin(std::min(options.max_walk_meters / (2.0 * R), M_PI / 2));
+    size_t max_count = static_cast<size_t>(std::max(options.max_count, 0));
+    std::vector<std::pair<double, uint32_t>> found = search(query, max_count, chord * chord);
+
+    if (found.size() < static_cast<size_t>(std::max(options.min_count, 0))) {
+        found = search(query, std::min(static_cast<size_t>(options.min_count), max_count), std::numeric_limits<double>::max());
+    }
+    return to_stops(latitude, longitude, found);
+}
+
+StopIndex load_stop_index(pqxx::connection &conn) {
+    pqxx::work txn(conn);
+    pqxx::result result = exec_timed(txn, "SELECT id, name, latitude, longitude FROM route_search_busstop "
+                                          "WHERE latitude IS NOT NULL AND longitude IS NOT NULL");
+
+    std::vector<BusStop> stops;
+    stops.reserve(result.size());
+    for (auto row : result) {
+        BusStop stop;
+        stop.id = row["id"].c_str();
+        stop.name = row["name"].c_str();
+        stop.latitude = row["latitude"].as<double>();
+        stop.longitude = row["longitude"].as<double>();
+        stop.distance = 0.0;
+        stops.push_back(stop);
+    }
+    return StopIndex(std::move(stops));
+}
+
+StopIndex build_stop_index(const TimetableSnapshot &snapshot) {
+    std::vector<BusStop> stops;
+    for (const auto &entry : snapshot.stops) {
+        const StopRecord &record = *entry.second->record;
+        stops.push_back({std::to_string(entry.first), std::string(entry.second->name), record.latitude, record.longitude, 0.0});
+    }
+    return StopIndex(std::move(stops));
+}
+
+uint32_t hilbert_index(uint32_t x, uint32_t y) {
+    uint32_t d = 0;
+    for (uint32_t s = 1u << 15; s > 0; s >>= 1) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+        // Rotate the quadrant so the curve stays continuous
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+std::vector<std::vector<BusStop>> nearest_stops_batch(const StopIndex &index, const std::vector<Coordinates> &locations, int size_of_response) {
+    std::vector<std::vector<BusStop>> results(locations.size());
+    if (locations.empty()) {
+        return results;
+    }
+
+    double min_lat = locations[0].latitude, max_lat = min_lat;
+    double min_lon = locations[0].longitude, max_lon = min_lon;
+    for (const Coordinates &location : locations) {
+        min_lat = std::min(min_lat, location.latitude);
+        max_lat = std::max(max_lat, location.latitude);
+        min_lon = std::min(min_lon, location.longitude);
+        max_lon = std::max(max_lon, location.longitude);
+    }
+    auto cell = [](double value, double low, double high) {
+        return high > low ? static_cast<uint32_t>((value - low) / (high - low) * 65535.0) : 0u;
+    };
+
+    std::vector<std::pair<uint32_t, uint32_t>> ordered(locations.size()); // (Hilbert index, location)
+    for (size_t i = 0; i < locations.size(); ++i) {
+        ordered[i] = {hilbert_index(cell(locations[i].longitude, min_lon, max_lon), cell(locations[i].latitude, min_lat, max_lat)),
+                      static_cast<uint32_t>(i)};
+    }
+    std::sort(ordered.begin(), ordered.end());
+
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < ordered.size(); ++i) {
+        const Coordinates &location = locations[ordered[i].second];
+        results[ordered[i].second] = index.nearest(location.latitude, location.longitude, size_of_response);
+    }
+    return results;
+}
+
+std::vector<std::vector<BusStop>> get_nearest_stops_batch(pqxx::connection &conn, const std::vector<Coordinates> &locations, int size_of_response) {
+    return nearest_stops_batch(load_stop_index(conn), locations, size_of_response);
+}
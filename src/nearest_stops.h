@@ -0,0 +1,60 @@
+#ifndef NEAREST_STOPS_H
+#define NEAREST_STOPS_H
+
+#include <cstdint>
+#include <vector>
+#include <pqxx/pqxx>
+#include "sequence.h"
+
+struct TimetableSnapshot;
+
+// Static k-d tree over bus stops for nearest-stop lookups. Stops are stored as points on
+// the unit sphere: straight-line distance between such points grows with the great-circle
+// distance, so the tree ranks stops exactly as haversine does without any projection.
+// Built once, then safe to query from any number of threads.
+class StopIndex {
+public:
+    explicit StopIndex(std::vector<BusStop> stops);
+
+    size_t size() const { return stops.size(); }
+
+    // The size_of_response stops nearest to a location, nearest first, with distance set in meters
+    std::vector<BusStop> nearest(double latitude, double longitude, int size_of_response) const;
+    // Stops to walk to from a location, nearest first, with distance set in meters
+    std::vector<BusStop> candidates(double latitude, double longitude, const CandidateOptions &options = CandidateOptions()) const;
+
+private:
+    struct Node {
+        uint32_t first; // range of points
+        uint32_t last;
+        uint8_t axis;   // split axis; leaves have no children
+        double split;
+    };
+
+    void build(uint32_t node, uint32_t first, uint32_t last);
+    // Function to collect up to k points within a squared chord length, as (squared chord, position in order)
+    std::vector<std::pair<double, uint32_t>> search(const double *query, size_t k, double max_distance) const;
+    std::vector<BusStop> to_stops(double latitude, double longitude, const std::vector<std::pair<double, uint32_t>> &found) const;
+
+    std::vector<BusStop> stops;
+    std::vector<double> points; // x, y, z per entry of order (per stop while building)
+    std::vector<uint32_t> order;
+    std::vector<Node> nodes;   // implicit binary tree: children of n are 2n + 1 and 2n + 2
+};
+
+// Function to load every stop with coordinates into an index
+StopIndex load_stop_index(pqxx::connection &conn);
+StopIndex build_stop_index(const TimetableSnapshot &snapshot);
+
+// Function to find the nearest stops for many locations at once: the locations are sorted
+// along a Hilbert curve and handed to the OpenMP threads in contiguous chunks, so consecutive
+// lookups on a thread walk the same tree nodes. Results are in the order of locations.
+std::vector<std::vector<BusStop>> nearest_stops_batch(const StopIndex &index, const std::vector<Coordinates> &locations, int size_of_response);
+
+// Function to do the same with one scan of route_search_busstop for the whole batch
+std::vector<std::vector<BusStop>> get_nearest_stops_batch(pqxx::connection &conn, const std::vector<Coordinates> &locations, int size_of_response);
+
+// Position of a point along a Hilbert curve filling a 2^16 x 2^16 grid
+uint32_t hilbert_index(uint32_t x, uint32_t y);
+
+#endif // NEAREST_STOPS_H
@@ -0,0 +1,107 @@
+#include "partition.h"
+#include <algorithm>
+
+int DayPartition::stop_index(int32_t stop_id) const {
+    auto it = std::lower_bound(stop_ids.begin(), stop_ids.end(), stop_id);
+    return it != stop_ids.end() && *it == stop_id ? static_cast<int>(it - stop_ids.begin()) : -1;
+}
+
+// Function to hash everything a router reads from one pattern (FNV-1a)
+static uint64_t pattern_fingerprint(const RoutePattern &pattern) {
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](const void *data, size_t size) {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+    };
+    add(&pattern.line_id, sizeof(pattern.line_id));
+    add(&pattern.route_day, sizeof(pattern.route_day));
+    add(pattern.stop_ids.data(), pattern.stop_ids.size() * sizeof(int32_t));
+    add(pattern.trip_ordinals.data(), pattern.trip_ordinals.size() * sizeof(int32_t));
+    add(pattern.stop_times.data(), pattern.stop_times.size() * sizeof(int32_t));
+    return hash;
+}
+
+std::shared_ptr<const DayPartition> build_day_partition(DayType day_type, const std::vector<std::shared_ptr<const RoutePattern>> &all_patterns) {
+    auto partition = std::make_shared<DayPartition>();
+    partition->day_type = day_type;
+
+    for (const auto &pattern : all_patterns) {
+        if (pattern->route_day == static_cast<uint8_t>(day_type)) {
+            partition->patterns.push_back(pattern);
+            // Summed, so the order the patterns come in does not matter
+            partition->fingerprint += pattern_fingerprint(*pattern);
+            partition->stop_ids.insert(partition->stop_ids.end(), pattern->stop_ids.begin(), pattern->stop_ids.end());
+        }
+    }
+
+    std::sort(partition->stop_ids.begin(), partition->stop_ids.end());
+    partition->stop_ids.erase(std::unique(partition->stop_ids.begin(), partition->stop_ids.end()), partition->stop_ids.end());
+
+    partition->pattern_stops.resize(partition->patterns.size());
+    partition->stop_patterns.resize(partition->stop_ids.size());
+    for (size_t p = 0; p < partition->patterns.size(); ++p) {
+        const RoutePattern &pattern = *partition->patterns[p];
+        for (size_t position = 0; position < pattern.stop_count(); ++position) {
+            uint32_t stop = static_cast<uint32_t>(partition->stop_index(pattern.stop_ids[position]));
+            partition->pattern_stops[p].push_back(stop);
+            partition->stop_patterns[stop].push_back({static_cast<uint32_t>(p), static_cast<uint32_t>(position)});
+        }
+    }
+
+    partition->stop_pattern_bits.resize(partition->stop_ids.size());
+    for (size_t stop = 0; stop < partition->stop_ids.size(); ++stop) {
+        std::vector<uint32_t> indices;
+        for (const PatternStop &entry : partition->stop_patterns[stop]) {
+            indices.push_back(entry.pattern);
+        }
+        partition->stop_pattern_bits[stop] = CompressedBitset(std::move(indices));
+    }
+
+    return partition;
+}
+
+DenseBitset patterns_serving(const DayPartition &partition, const std::vector<int32_t> &stop_ids) {
+    DenseBitset patterns(partition.patterns.size());
+    for (int32_t stop_id : stop_ids) {
+        int stop = partition.stop_index(stop_id);
+        if (stop >= 0) {
+            patterns |= partition.stop_pattern_bits[stop];
+        }
+    }
+    return patterns;
+}
+
+TransferCandidates find_transfer_candidates(const DayPartition &partition, const std::vector<int32_t> &origin_stop_ids, const std::vector<int32_t> &goal_stop_ids) {
+    TransferCandidates candidates;
+    candidates.origin_patterns = patterns_serving(partition, origin_stop_ids);
+    candidates.goal_patterns = patterns_serving(partition, goal_stop_ids);
+
+    DenseBitset both = candidates.origin_patterns;
+    both &= candidates.goal_patterns;
+    candidates.direct_patterns = both.to_indices();
+
+    if (candidates.origin_patterns.none() || candidates.goal_patterns.none()) {
+        return candidates;
+    }
+
+    for (size_t stop = 0; stop < partition.stop_count(); ++stop) {
+        const CompressedBitset &serving = partition.stop_pattern_bits[stop];
+        size_t from_origin = serving.and_count(candidates.origin_patterns);
+        if (from_origin == 0) {
+            continue;
+        }
+        size_t to_goal = serving.and_count(candidates.goal_patterns);
+        if (to_goal == 0) {
+            continue;
+        }
+        // A single pattern on both sides is a direct ride, not a transfer
+        if (from_origin == 1 && to_goal == 1 && serving.and_count(both) == 1) {
+            continue;
+        }
+        candidates.transfer_stops.push_back(static_cast<uint32_t>(stop));
+    }
+
+    return candidates;
+}
@@ -0,0 +1,54 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "calendar.h"
+#include "route_patterns.h"
+#include "pattern_bitset.h"
+
+// A pattern serving a stop, and where along the pattern the stop is
+struct PatternStop {
+    uint32_t pattern;
+    uint32_t position;
+};
+
+// Everything that runs on one day type, pre-filtered at snapshot load so a query only
+// touches the patterns of its own day. Stops are renumbered densely (0..stop_count-1)
+// so routers can keep per-stop state in plain arrays.
+struct DayPartition {
+    DayType day_type = DayType::Working;
+    std::vector<int32_t> stop_ids;                              // dense stop index -> stop id, sorted
+    std::vector<std::shared_ptr<const RoutePattern>> patterns;
+    std::vector<std::vector<uint32_t>> pattern_stops;           // pattern -> dense stop index per position
+    std::vector<std::vector<PatternStop>> stop_patterns;        // dense stop index -> patterns serving it
+    std::vector<CompressedBitset> stop_pattern_bits;            // the same, as a set of pattern indices
+    // Hash of the patterns' lines, stops and times, independent of their order, so the same
+    // timetable gives the same value whether it came from a file or from the database
+    uint64_t fingerprint = 0;
+
+    size_t stop_count() const { return stop_ids.size(); }
+    // Dense index of a stop id, or -1 if no pattern of this day serves it
+    int stop_index(int32_t stop_id) const;
+};
+
+// Patterns serving the origin and goal stops, and the stops where one of the first can
+// meet a different one of the second. Found from the bitsets alone, before any departure
+// is read, so it is a superset: stop order along the patterns is not checked here.
+struct TransferCandidates {
+    DenseBitset origin_patterns;
+    DenseBitset goal_patterns;
+    std::vector<uint32_t> direct_patterns; // serve an origin and a goal stop
+    std::vector<uint32_t> transfer_stops;  // dense stop indices
+};
+
+// Function to union the pattern sets of the given stops (ids unknown to the partition are ignored)
+DenseBitset patterns_serving(const DayPartition &partition, const std::vector<int32_t> &stop_ids);
+
+TransferCandidates find_transfer_candidates(const DayPartition &partition, const std::vector<int32_t> &origin_stop_ids, const std::vector<int32_t> &goal_stop_ids);
+
+// Function to build the partition of one day type from the patterns of all lines
+std::shared_ptr<const DayPartition> build_day_partition(DayType day_type, const std::vector<std::shared_ptr<const RoutePattern>> &all_patterns);
+
+#endif // PARTITION_H
@@ -0,0 +1,151 @@
+#include "pattern_bitset.h"
+#include <algorithm>
+
+CompressedBitset::CompressedBitset(std::vector<uint32_t> indices) {
+    std::sort(indices.begin(), indices.end());
+    for (uint32_t index : indices) {
+        uint32_t word = index / 64;
+        if (word_index.empty() || word_index.back() != word) {
+            word_index.push_back(word);
+            words.push_back(0);
+        }
+        words.back() |= uint64_t(1) << (index % 64);
+    }
+}
+
+size_t CompressedBitset::count() const {
+    size_t total = 0;
+    for (uint64_t word : words) {
+        total += __builtin_popcountll(word);
+    }
+    return total;
+}
+
+bool CompressedBitset::contains(uint32_t index) const {
+    auto it = std::lower_bound(word_index.begin(), word_index.end(), index / 64);
+    if (it == word_index.end() || *it != index / 64) {
+        return false;
+    }
+    return (words[it - word_index.begin()] >> (index % 64)) & 1;
+}
+
+std::vector<uint32_t> CompressedBitset::to_indices() const {
+    std::vector<uint32_t> indices;
+    for (size_t i = 0; i < words.size(); ++i) {
+        for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+            indices.push_back(word_index[i] * 64 + __builtin_ctzll(word));
+        }
+    }
+    return indices;
+}
+
+size_t CompressedBitset::and_count(const CompressedBitset &other) const {
+    // Merge over the two sorted word lists
+    size_t total = 0;
+    size_t i = 0, j = 0;
+    while (i < word_index.size() && j < other.word_index.size()) {
+        if (word_index[i] < other.word_index[j]) {
+            ++i;
+        } else if (word_index[i] > other.word_index[j]) {
+            ++j;
+        } else {
+            total += __builtin_popcountll(words[i++] & other.words[j++]);
+        }
+    }
+    return total;
+}
+
+size_t CompressedBitset::and_count(const DenseBitset &other) const {
+    size_t total = 0;
+    for (size_t i = 0; i < words.size() && word_index[i] < other.words.size(); ++i) {
+        total += __builtin_popcountll(words[i] & other.words[word_index[i]]);
+    }
+    return total;
+}
+
+bool CompressedBitset::intersects(const DenseBitset &other) const {
+    for (size_t i = 0; i < words.size() && word_index[i] < other.words.size(); ++i) {
+        if (words[i] & other.words[word_index[i]]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+DenseBitset::DenseBitset(size_t size) : words((size + 63) / 64, 0), bit_count(size) {}
+
+void DenseBitset::set(uint32_t index) {
+    words[index / 64] |= uint64_t(1) << (index % 64);
+}
+
+bool DenseBitset::test(uint32_t index) const {
+    return index < bit_count && ((words[index / 64] >> (index % 64)) & 1);
+}
+
+bool DenseBitset::none() const {
+    return std::all_of(words.begin(), words.end(), [](uint64_t word) { return word == 0; });
+}
+
+size_t DenseBitset::count() const {
+    size_t total = 0;
+    const uint64_t *data = words.data();
+    size_t n = words.size();
+    #pragma omp simd reduction(+:total)
+    for (size_t i = 0; i < n; ++i) {
+        total += __builtin_popcountll(data[i]);
+    }
+    return total;
+}
+
+std::vector<uint32_t> DenseBitset::to_indices() const {
+    std::vector<uint32_t> indices;
+    for (size_t i = 0; i < words.size(); ++i) {
+        for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+            indices.push_back(static_cast<uint32_t>(i * 64 + __builtin_ctzll(word)));
+        }
+    }
+    return indices;
+}
+
+DenseBitset &DenseBitset::operator|=(const CompressedBitset &other) {
+    for (size_t i = 0; i < other.words.size() && other.word_index[i] < words.size(); ++i) {
+        words[other.word_index[i]] |= other.words[i];
+    }
+    return *this;
+}
+
+// The word loops below are written over raw pointers so the compiler can vectorise them
+DenseBitset &DenseBitset::operator|=(const DenseBitset &other) {
+    uint64_t *data = words.data();
+    const uint64_t *other_data = other.words.data();
+    size_t n = std::min(words.size(), other.words.size());
+    #pragma omp simd
+    for (size_t i = 0; i < n; ++i) {
+        data[i] |= other_data[i];
+    }
+    return *this;
+}
+
+DenseBitset &DenseBitset::operator&=(const DenseBitset &other) {
+    uint64_t *data = words.data();
+    const uint64_t *other_data = other.words.data();
+    size_t n = std::min(words.size(), other.words.size());
+    #pragma omp simd
+    for (size_t i = 0; i < n; ++i) {
+        data[i] &= other_data[i];
+    }
+    std::fill(words.begin() + n, words.end(), 0);
+    return *this;
+}
+
+size_t DenseBitset::and_count(const DenseBitset &other) const {
+    size_t total = 0;
+    const uint64_t *data = words.data();
+    const uint64_t *other_data = other.words.data();
+    size_t n = std::min(words.size(), other.words.size());
+    #pragma omp simd reduction(+:total)
+    for (size_t i = 0; i < n; ++i) {
+        total += __builtin_popcountll(data[i] & other_data[i]);
+    }
+    return total;
+}
@@ -0,0 +1,62 @@
+#ifndef PATTERN_BITSET_H
+#define PATTERN_BITSET_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class DenseBitset;
+
+// Set of pattern indices stored as its non-zero 64-bit words only. A stop is served
+// by a handful of the thousands of patterns in a partition, so this keeps the
+// stop -> patterns index a few words per stop instead of a full bitmap each.
+class CompressedBitset {
+public:
+    CompressedBitset() = default;
+    // Builds the set from indices in any order (duplicates are fine)
+    explicit CompressedBitset(std::vector<uint32_t> indices);
+
+    bool empty() const { return words.empty(); }
+    size_t count() const;
+    bool contains(uint32_t index) const;
+    std::vector<uint32_t> to_indices() const;
+
+    // Sizes of the intersections, without materialising them
+    size_t and_count(const CompressedBitset &other) const;
+    size_t and_count(const DenseBitset &other) const;
+    bool intersects(const DenseBitset &other) const;
+
+private:
+    friend class DenseBitset;
+
+    std::vector<uint32_t> word_index; // ascending
+    std::vector<uint64_t> words;      // never zero
+};
+
+// Plain bitmap over [0, size), used to accumulate unions of compressed sets
+// (e.g. every pattern leaving any origin stop) and intersect them word by word.
+class DenseBitset {
+public:
+    DenseBitset() = default;
+    explicit DenseBitset(size_t size);
+
+    size_t size() const { return bit_count; }
+    void set(uint32_t index);
+    bool test(uint32_t index) const;
+    bool none() const;
+    size_t count() const;
+    std::vector<uint32_t> to_indices() const;
+
+    DenseBitset &operator|=(const CompressedBitset &other);
+    DenseBitset &operator|=(const DenseBitset &other);
+    DenseBitset &operator&=(const DenseBitset &other);
+    size_t and_count(const DenseBitset &other) const;
+
+private:
+    friend class CompressedBitset;
+
+    std::vector<uint64_t> words;
+    size_t bit_count = 0;
+};
+
+#endif // PATTERN_BITSET_H
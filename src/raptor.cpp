@@ -0,0 +1,353 @@
+#include "raptor.h"
+#include <algorithm>
+#include "snapshot.h"
+#include "calendar.h"
+#include "latency.h"
+
+static const uint32_t NOT_QUEUED = std::numeric_limits<uint32_t>::max();
+
+RaptorSearch::RaptorSearch(const DayPartition &partition, RaptorOptions options)
+    : day(partition), options(options),
+      labels(options.max_legs + 1, std::vector<Label>(partition.stop_count())),
+      source_walk(partition.stop_count(), RAPTOR_UNREACHED),
+      target_walk(partition.stop_count(), RAPTOR_UNREACHED),
+      target_best(options.max_legs + 1, RAPTOR_UNREACHED),
+      marked(partition.stop_count(), 0),
+      improved_flag(partition.stop_count(), 0),
+      queue_position(partition.patterns.size(), NOT_QUEUED) {}
+
+void RaptorSearch::set_targets(const std::vector<StopAccess> &goals) {
+    std::fill(target_walk.begin(), target_walk.end(), RAPTOR_UNREACHED);
+    target_stops.clear();
+    min_target_walk = RAPTOR_UNREACHED;
+    for (const StopAccess &goal : goals) {
+        int stop = day.stop_index(goal.stop_id);
+        if (stop < 0) {
+            continue;
+        }
+        if (target_walk[stop] == RAPTOR_UNREACHED) {
+            target_stops.push_back(static_cast<uint32_t>(stop));
+        }
+        target_walk[stop] = std::min(target_walk[stop], goal.walk_seconds);
+        min_target_walk = std::min(min_target_walk, goal.walk_seconds);
+    }
+    if (target_stops.empty()) {
+        min_target_walk = 0;
+    }
+    std::fill(target_best.begin(), target_best.end(), RAPTOR_UNREACHED);
+}
+
+void RaptorSearch::reset() {
+    for (auto &round : labels) {
+        std::fill(round.begin(), round.end(), Label());
+    }
+    std::fill(source_walk.begin(), source_walk.end(), RAPTOR_UNREACHED);
+    std::fill(target_best.begin(), target_best.end(), RAPTOR_UNREACHED);
+}
+
+int32_t RaptorSearch::best_time(uint32_t stop, int legs) const {
+    return from_key(labels[legs][stop].key);
+}
+
+int32_t RaptorSearch::target_time(int legs) const {
+    return from_key(target_best[legs]);
+}
+
+// Function to store a better label; rounds above keep "at most k legs" monotone
+void RaptorSearch::improve(int round, uint32_t stop, const Label &label) {
+    for (int r = round; r <= options.max_legs && label.key < labels[r][stop].key; ++r) {
+        if (r == round) {
+            labels[r][stop] = label;
+        } else {
+            labels[r][stop] = Label();
+            labels[r][stop].key = label.key;
+            labels[r][stop].legs = label.legs;
+        }
+        if (target_walk[stop] != RAPTOR_UNREACHED) {
+            target_best[r] = std::min(target_best[r], label.key + target_walk[stop]);
+        }
+    }
+    if (!marked[stop]) {
+        marked[stop] = 1;
+        marked_stops.push_back(stop);
+    }
+    if (!improved_flag[stop]) {
+        improved_flag[stop] = 1;
+        improved.push_back(stop);
+    }
+}
+
+void RaptorSearch::scan_pattern(int round, uint32_t pattern_index, uint32_t first_position) {
+    const RoutePattern &pattern = *day.patterns[pattern_index];
+    const std::vector<uint32_t> &stops = day.pattern_stops[pattern_index];
+    const std::vector<Label> &previous = labels[round - 1];
+    const bool backwards = options.arrive_by;
+    const int step = backwards ? -1 : 1;
+    const int last_position = backwards ? 0 : static_cast<int>(stops.size()) - 1;
+    int trip = -1;
+    uint32_t board_position = 0;
+    uint8_t board_legs = 0;
+
+    for (int position = static_cast<int>(first_position); position >= 0 && position < static_cast<int>(stops.size()); position += step) {
+        uint32_t stop = stops[position];
+
+        if (trip >= 0) {
+            int32_t key = to_key(pattern.time(trip, position));
+            int32_t bound = std::min(labels[round][stop].key, key_limit);
+            if (target_best[round] != RAPTOR_UNREACHED) {
+                bound = std::min(bound, target_best[round] - min_target_walk);
+            }
+            if (key < bound) {
+                Label label;
+                label.key = key;
+                label.pattern = static_cast<int32_t>(pattern_index);
+                label.trip = static_cast<uint32_t>(trip);
+                label.board_position = board_position;
+                label.alight_position = static_cast<uint32_t>(position);
+                label.legs = board_legs + 1;
+                improve(round, stop, label);
+            }
+        }
+
+        // Catch a better trip of the pattern here (an earlier one forwards, a later one
+        // backwards), if the stop was reached in time
+        if (position == last_position || previous[stop].key == RAPTOR_UNREACHED) {
+            continue;
+        }
+        int32_t ready = previous[stop].key + (previous[stop].legs > 0 ? options.change_seconds : 0);
+        if (trip >= 0 && ready > to_key(pattern.time(trip, position))) {
+            continue;
+        }
+        int better = backwards ? pattern.last_trip_before(position, -ready) : pattern.first_trip_after(position, ready);
+        if (better >= 0 && (trip < 0 || (backwards ? better > trip : better < trip))) {
+            trip = better;
+            board_position = static_cast<uint32_t>(position);
+            board_legs = previous[stop].legs;
+        }
+    }
+}
+
+void RaptorSearch::run(const std::vector<StopAccess> &sources, int32_t time) {
+    for (uint32_t stop : marked_stops) {
+        marked[stop] = 0;
+    }
+    marked_stops.clear();
+    for (uint32_t stop : improved) {
+        improved_flag[stop] = 0;
+    }
+    improved.clear();
+    key_limit = options.max_duration == RAPTOR_UNREACHED ? RAPTOR_UNREACHED : to_key(time) + options.max_duration + 1;
+
+    for (const StopAccess &source : sources) {
+        int stop = day.stop_index(source.stop_id);
+        if (stop < 0) {
+            continue;
+        }
+        source_walk[stop] = std::min(source_walk[stop], source.walk_seconds);
+        Label label;
+        label.key = to_key(time) + source.walk_seconds;
+        if (label.key < labels[0][stop].key) {
+            improve(0, static_cast<uint32_t>(stop), label);
+        }
+    }
+
+    for (int round = 1; round <= options.max_legs && !marked_stops.empty(); ++round) {
+        // Every pattern through an improved stop, from the first such stop in scan order
+        for (uint32_t stop : marked_stops) {
+            marked[stop] = 0;
+            for (const PatternStop &entry : day.stop_patterns[stop]) {
+                uint32_t &position = queue_position[entry.pattern];
+                if (position == NOT_QUEUED) {
+                    queued_patterns.push_back(entry.pattern);
+                    position = entry.position;
+                } else {
+                    position = options.arrive_by ? std::max(position, entry.position) : std::min(position, entry.position);
+                }
+            }
+        }
+        marked_stops.clear();
+
+        for (uint32_t pattern : queued_patterns) {
+            scan_pattern(round, pattern, queue_position[pattern]);
+            queue_position[pattern] = NOT_QUEUED;
+        }
+        queued_patterns.clear();
+    }
+}
+
+Journey RaptorSearch::journey(uint32_t stop, int legs) const {
+    Journey result;
+    int32_t stop_time = best_time(stop, legs);
+
+    // Follow the labels back to a source; forwards that visits the legs last to first
+    int round = legs;
+    while (true) {
+        const Label &label = labels[round][stop];
+        if (label.pattern < 0) {
+            if (round == 0) {
+                break;
+            }
+            --round;
+            continue;
+        }
+        const RoutePattern &pattern = *day.patterns[label.pattern];
+        uint32_t from = options.arrive_by ? label.alight_position : label.board_position;
+        uint32_t to = options.arrive_by ? label.board_position : label.alight_position;
+        result.legs.push_back({pattern.line_id, pattern.trip_ordinals[label.trip],
+                               pattern.stop_ids[from], pattern.stop_ids[to],
+                               pattern.time(label.trip, from), pattern.time(label.trip, to)});
+        stop = day.pattern_stops[label.pattern][label.board_position];
+        --round;
+    }
+
+    int32_t walk = source_walk[stop] == RAPTOR_UNREACHED ? 0 : source_walk[stop];
+    int32_t source_time = from_key(labels[0][stop].key - walk);
+    if (options.arrive_by) {
+        result.departure_time = stop_time;
+        result.arrival_time = result.legs.empty() ? source_time : result.legs.back().arrival_time + walk;
+    } else {
+        std::reverse(result.legs.begin(), result.legs.end());
+        result.departure_time = result.legs.empty() ? source_time : result.legs.front().departure_time - walk;
+        result.arrival_time = stop_time;
+    }
+    return result;
+}
+
+Journey RaptorSearch::target_journey(int legs) const {
+    uint32_t best_stop = 0;
+    int32_t best_key = RAPTOR_UNREACHED;
+    for (uint32_t stop : target_stops) {
+        int32_t key = labels[legs][stop].key;
+        if (key != RAPTOR_UNREACHED && key + target_walk[stop] < best_key) {
+            best_key = key + target_walk[stop];
+            best_stop = stop;
+        }
+    }
+
+    Journey result = journey(best_stop, legs);
+    if (options.arrive_by) {
+        result.departure_time = from_key(best_key);
+    } else {
+        result.arrival_time = from_key(best_key);
+    }
+    return result;
+}
+
+void RaptorSearch::collect_journeys(std::vector<int32_t> &recorded, std::vector<Journey> &journeys) const {
+    for (int legs = 1; legs <= options.max_legs; ++legs) {
+        if (target_best[legs] < recorded[legs] && target_best[legs] < target_best[legs - 1]) {
+            journeys.push_back(target_journey(legs));
+        }
+    }
+    recorded = target_best;
+}
+
+std::vector<Journey> raptor_earliest_arrival(const DayPartition &partition, const std::vector<StopAccess> &origins, const std::vector<StopAccess> &goals, int32_t departure_time, const RaptorOptions &options) {
+    RaptorOptions forwards = options;
+    forwards.arrive_by = false;
+    RaptorSearch search(partition, forwards);
+    search.set_targets(goals);
+    search.run(origins, departure_time);
+
+    std::vector<Journey> journeys;
+    std::vector<int32_t> recorded(options.max_legs + 1, RAPTOR_UNREACHED);
+    search.collect_journeys(recorded, journeys);
+    return journeys;
+}
+
+std::vector<Journey> raptor_arrive_by(const DayPartition &partition, const std::vector<StopAccess> &origins, const std::vector<StopAccess> &goals, int32_t deadline, const RaptorOptions &options) {
+    RaptorOptions backwards = options;
+    backwards.arrive_by = true;
+    RaptorSearch search(partition, backwards);
+    search.set_targets(origins);
+    search.run(goals, deadline);
+
+    std::vector<Journey> journeys;
+    std::vector<int32_t> recorded(options.max_legs + 1, RAPTOR_UNREACHED);
+    search.collect_journeys(recorded, journeys);
+    return journeys;
+}
+
+std::vector<Journey> raptor_profile(const DayPartition &partition, const std::vector<StopAccess> &origins, const std::vector<StopAccess> &goals, int32_t window_start, int32_t window_end, const RaptorOptions &options) {
+    // Every moment in the window at which leaving lets the rider catch a trip at an origin
+    std::vector<int32_t> departure_times;
+    for (const StopAccess &origin : origins) {
+        int stop = partition.stop_index(origin.stop_id);
+        if (stop < 0) {
+            continue;
+        }
+        for (const PatternStop &entry : partition.stop_patterns[stop]) {
+            const RoutePattern &pattern = *partition.patterns[entry.pattern];
+            if (entry.position + 1 == pattern.stop_count()) {
+                continue;
+            }
+            const int32_t *times = pattern.column(entry.position);
+            for (size_t trip = 0; trip < pattern.trip_count(); ++trip) {
+                int32_t leave = times[trip] - origin.walk_seconds;
+                if (leave >= window_start && leave <= window_end) {
+                    departure_times.push_back(leave);
+                }
+            }
+        }
+    }
+    std::sort(departure_times.begin(), departure_times.end(), std::greater<int32_t>());
+    departure_times.erase(std::unique(departure_times.begin(), departure_times.end()), departure_times.end());
+
+    RaptorOptions forwards = options;
+    forwards.arrive_by = false;
+    RaptorSearch search(partition, forwards);
+    search.set_targets(goals);
+    std::vector<Journey> journeys;
+    std::vector<int32_t> recorded(options.max_legs + 1, RAPTOR_UNREACHED);
+    for (int32_t departure_time : departure_times) {
+        search.run(origins, departure_time);
+        search.collect_journeys(recorded, journeys);
+    }
+
+    std::sort(journeys.begin(), journeys.end(), [](const Journey &a, const Journey &b) {
+        if (a.departure_time != b.departure_time) {
+            return a.departure_time < b.departure_time;
+        }
+        return a.arrival_time < b.arrival_time;
+    });
+    return journeys;
+}
+
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes_raptor(const TimetableSnapshot &snapshot, Coordinates start_coords, Coordinates goal_coords, const std::string &date, const std::string &time) {
+    ScopedLatency timer(LatencyEndpoint::FindRoutesRaptor);
+    const DayPartition &partition = snapshot.partition(day_type_for_date(date));
+    std::vector<StopAccess> origins = candidate_stop_access(snapshot, start_coords);
+    std::vector<StopAccess> goals = candidate_stop_access(snapshot, goal_coords);
+
+    std::vector<std::variant<Solution, SolutionTwoBuses>> solutions;
+    for (const Journey &journey : raptor_earliest_arrival(partition, origins, goals, parse_time_of_day(time))) {
+        solutions.push_back(journey_to_solution(snapshot, journey));
+    }
+    return solutions;
+}
+
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes_profile(const TimetableSnapshot &snapshot, Coordinates start_coords, Coordinates goal_coords, const std::string &date, const std::string &window_start, const std::string &window_end) {
+    ScopedLatency timer(LatencyEndpoint::FindRoutesProfile);
+    const DayPartition &partition = snapshot.partition(day_type_for_date(date));
+    std::vector<StopAccess> origins = candidate_stop_access(snapshot, start_coords);
+    std::vector<StopAccess> goals = candidate_stop_access(snapshot, goal_coords);
+
+    std::vector<std::variant<Solution, SolutionTwoBuses>> solutions;
+    for (const Journey &journey : raptor_profile(partition, origins, goals, parse_time_of_day(window_start), parse_time_of_day(window_end))) {
+        solutions.push_back(journey_to_solution(snapshot, journey));
+    }
+    return solutions;
+}
+
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes_arrive_by(const TimetableSnapshot &snapshot, Coordinates start_coords, Coordinates goal_coords, const std::string &date, const std::string &deadline) {
+    ScopedLatency timer(LatencyEndpoint::FindRoutesArriveBy);
+    const DayPartition &partition = snapshot.partition(day_type_for_date(date));
+    std::vector<StopAccess> origins = candidate_stop_access(snapshot, start_coords);
+    std::vector<StopAccess> goals = candidate_stop_access(snapshot, goal_coords);
+
+    std::vector<std::variant<Solution, SolutionTwoBuses>> solutions;
+    for (const Journey &journey : raptor_arrive_by(partition, origins, goals, parse_time_of_day(deadline))) {
+        solutions.push_back(journey_to_solution(snapshot, journey));
+    }
+    return solutions;
+}
@@ -0,0 +1,117 @@
+#ifndef RAPTOR_H
+#define RAPTOR_H
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+#include "partition.h"
+#include "journey.h"
+
+const int32_t RAPTOR_UNREACHED = std::numeric_limits<int32_t>::max();
+
+struct RaptorOptions {
+    int max_legs = 2;           // 2 allows one change, like find_routes
+    int32_t change_seconds = 0; // minimum time between leaving one bus and boarding the next
+    bool arrive_by = false;     // search backwards in time, from the goals towards the origins
+    int32_t max_duration = RAPTOR_UNREACHED; // drop labels more than this many seconds from the start time
+};
+
+// Round-based public transit search (RAPTOR) over one day partition. Round k scans the
+// patterns serving the stops improved in round k - 1, so after k rounds every stop holds
+// its earliest arrival using at most k legs. Labels survive between runs: running again
+// with an earlier departure time only improves them, which is what rRAPTOR profile
+// queries rely on. One search object is meant to be reused by one thread.
+//
+// With arrive_by set the search runs backwards: it starts from the goals at the deadline,
+// scans patterns against their direction and every stop holds the latest time a rider can
+// leave it and still make the deadline. Internally times are kept as keys (the time, or its
+// negation when searching backwards), so "smaller is better" holds in both directions.
+class RaptorSearch {
+public:
+    RaptorSearch(const DayPartition &partition, RaptorOptions options = RaptorOptions());
+
+    // Stops to prune against (the origins when searching backwards); without targets the
+    // search is one-to-all
+    void set_targets(const std::vector<StopAccess> &goals);
+    // Forget all labels, for an unrelated query
+    void reset();
+    // Leave the sources at time (arrive at them by time when searching backwards) and run all rounds
+    void run(const std::vector<StopAccess> &sources, int32_t time);
+
+    // Earliest arrival at (latest departure from) a dense stop index using at most legs rides,
+    // or RAPTOR_UNREACHED
+    int32_t best_time(uint32_t stop, int legs) const;
+    // The same for the targets, walk included
+    int32_t target_time(int legs) const;
+    // The journey behind best_time(stop, legs); the walk between the stop and the target
+    // address is not included
+    Journey journey(uint32_t stop, int legs) const;
+    // The journey behind target_time(legs)
+    Journey target_journey(int legs) const;
+    // Function to append the journeys of the last run that beat everything found before it,
+    // one per number of legs; recorded carries the target keys from run to run
+    void collect_journeys(std::vector<int32_t> &recorded, std::vector<Journey> &journeys) const;
+
+    // Stops whose label improved in the last run, in no particular order
+    const std::vector<uint32_t> &improved_stops() const { return improved; }
+
+    const DayPartition &partition() const { return day; }
+    int max_legs() const { return options.max_legs; }
+
+private:
+    struct Label {
+        int32_t key = RAPTOR_UNREACHED;
+        int32_t pattern = -1; // -1: carried over from an earlier round, or a source in round 0
+        uint32_t trip = 0;
+        uint32_t board_position = 0;
+        uint32_t alight_position = 0;
+        uint8_t legs = 0;
+    };
+
+    int32_t to_key(int32_t time) const { return options.arrive_by ? -time : time; }
+    int32_t from_key(int32_t key) const { return key == RAPTOR_UNREACHED ? RAPTOR_UNREACHED : to_key(key); }
+    void improve(int round, uint32_t stop, const Label &label);
+    void scan_pattern(int round, uint32_t pattern, uint32_t first_position);
+
+    const DayPartition &day;
+    RaptorOptions options;
+    std::vector<std::vector<Label>> labels;   // labels[round][stop]
+    std::vector<int32_t> source_walk;         // per stop, RAPTOR_UNREACHED if not a source
+    std::vector<int32_t> target_walk;         // per stop, RAPTOR_UNREACHED if not a target
+    std::vector<uint32_t> target_stops;
+    int32_t min_target_walk = 0;
+    int32_t key_limit = RAPTOR_UNREACHED;     // from max_duration, for the current run
+    std::vector<int32_t> target_best;         // per round, key with walk included
+    std::vector<uint8_t> marked;
+    std::vector<uint32_t> marked_stops;
+    std::vector<uint8_t> improved_flag;
+    std::vector<uint32_t> improved;
+    std::vector<uint32_t> queue_position;     // per pattern, first position to scan from (in scan order)
+    std::vector<uint32_t> queued_patterns;
+};
+
+// Function to find the fastest journeys leaving at or after departure_time: one per number
+// of legs, each arriving strictly earlier than every journey with fewer legs
+std::vector<Journey> raptor_earliest_arrival(const DayPartition &partition, const std::vector<StopAccess> &origins, const std::vector<StopAccess> &goals, int32_t departure_time, const RaptorOptions &options = RaptorOptions());
+
+// Function to answer "when can I leave between window_start and window_end?" in one rRAPTOR
+// pass: every journey in the window that no other journey beats by leaving later, arriving
+// earlier or using fewer legs, sorted by departure time. Departure times are scanned from
+// the latest down and the labels of later departures prune the earlier runs.
+std::vector<Journey> raptor_profile(const DayPartition &partition, const std::vector<StopAccess> &origins, const std::vector<StopAccess> &goals, int32_t window_start, int32_t window_end, const RaptorOptions &options = RaptorOptions());
+
+// Function to find the latest-departure journeys that still reach a goal by the deadline:
+// one per number of legs, each leaving strictly later than every journey with fewer legs
+std::vector<Journey> raptor_arrive_by(const DayPartition &partition, const std::vector<StopAccess> &origins, const std::vector<StopAccess> &goals, int32_t deadline, const RaptorOptions &options = RaptorOptions());
+
+// Function to run an earliest-arrival query between two geocoded locations over a snapshot, with the time as HH:MM
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes_raptor(const TimetableSnapshot &snapshot, Coordinates start_coords, Coordinates goal_coords, const std::string &date, const std::string &time);
+
+// Function to run a profile query between two geocoded locations over a snapshot, with times as HH:MM
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes_profile(const TimetableSnapshot &snapshot, Coordinates start_coords, Coordinates goal_coords, const std::string &date, const std::string &window_start, const std::string &window_end);
+
+// Function to run an arrive-by query between two geocoded locations over a snapshot, with the deadline as HH:MM
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes_arrive_by(const TimetableSnapshot &snapshot, Coordinates start_coords, Coordinates goal_coords, const std::string &date, const std::string &deadline);
+
+#endif // RAPTOR_H
@@ -0,0 +1,99 @@
+#include "route_patterns.h"
+#include <algorithm>
+#include <map>
+#include <utility>
+
+int RoutePattern::first_trip_after(size_t position, int32_t time) const {
+    const int32_t *times = column(position);
+    const int32_t *it = std::lower_bound(times, times + trip_count(), time);
+    return it == times + trip_count() ? -1 : static_cast<int>(it - times);
+}
+
+int RoutePattern::last_trip_before(size_t position, int32_t time) const {
+    const int32_t *times = column(position);
+    const int32_t *it = std::upper_bound(times, times + trip_count(), time);
+    return it == times ? -1 : static_cast<int>(it - times) - 1;
+}
+
+// One trip while grouping: its rows in the departure view, in visiting order
+struct TripRows {
+    uint8_t route_day;
+    int32_t ordinal;
+    size_t first;
+    size_t count;
+};
+
+std::vector<std::shared_ptr<const RoutePattern>> build_route_patterns(int32_t line_id, const DepartureView &departures) {
+    // Rows are sorted by (route_day, departure_ordinal_number, stop position), so a trip is a run of rows
+    std::vector<TripRows> trips;
+    for (size_t i = 0; i < departures.count;) {
+        size_t end = i;
+        while (end < departures.count && departures.route_day[end] == departures.route_day[i] &&
+               departures.departure_ordinal_number[end] == departures.departure_ordinal_number[i]) {
+            ++end;
+        }
+        trips.push_back({departures.route_day[i], departures.departure_ordinal_number[i], i, end - i});
+        i = end;
+    }
+
+    std::stable_sort(trips.begin(), trips.end(), [&](const TripRows &a, const TripRows &b) {
+        return departures.time[a.first] < departures.time[b.first];
+    });
+
+    // Patterns under construction, keyed by day type and stop sequence. A trip that would
+    // overtake the last trip of every existing pattern for its key starts a new one.
+    std::map<std::pair<uint8_t, std::vector<int32_t>>, std::vector<std::shared_ptr<RoutePattern>>> patterns_by_key;
+    std::vector<std::shared_ptr<RoutePattern>> patterns;
+
+    for (const TripRows &trip : trips) {
+        std::vector<int32_t> stop_ids(departures.bus_stop_id + trip.first, departures.bus_stop_id + trip.first + trip.count);
+        // Stop times never go backwards along a trip; one that does is on the next day
+        std::vector<int32_t> times(departures.time + trip.first, departures.time + trip.first + trip.count);
+        for (size_t position = 1, day = 0; position < trip.count; ++position) {
+            if (times[position] + static_cast<int32_t>(day) * 86400 < times[position - 1]) {
+                ++day;
+            }
+            times[position] += static_cast<int32_t>(day) * 86400;
+        }
+        auto &candidates = patterns_by_key[{trip.route_day, stop_ids}];
+
+        std::shared_ptr<RoutePattern> target;
+        for (const auto &candidate : candidates) {
+            size_t last_trip = candidate->trip_count() - 1;
+            bool fifo = true;
+            for (size_t position = 0; position < trip.count && fifo; ++position) {
+                fifo = candidate->time(last_trip, position) <= times[position];
+            }
+            if (fifo) {
+                target = candidate;
+                break;
+            }
+        }
+
+        if (!target) {
+            target = std::make_shared<RoutePattern>();
+            target->line_id = line_id;
+            target->route_day = trip.route_day;
+            target->stop_ids = stop_ids;
+            candidates.push_back(target);
+            patterns.push_back(target);
+        }
+
+        target->trip_ordinals.push_back(trip.ordinal);
+        target->stop_times.insert(target->stop_times.end(), times.begin(), times.end());
+    }
+
+    std::vector<std::shared_ptr<const RoutePattern>> result;
+    for (auto &pattern : patterns) {
+        size_t trip_count = pattern->trip_count();
+        size_t stop_count = pattern->stop_count();
+        pattern->departures_by_stop.resize(trip_count * stop_count);
+        for (size_t trip = 0; trip < trip_count; ++trip) {
+            for (size_t position = 0; position < stop_count; ++position) {
+                pattern->departures_by_stop[position * trip_count + trip] = pattern->time(trip, position);
+            }
+        }
+        result.push_back(pattern);
+    }
+    return result;
+}
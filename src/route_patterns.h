@@ -0,0 +1,38 @@
+#ifndef ROUTE_PATTERNS_H
+#define ROUTE_PATTERNS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "timetable.h"
+
+// Trips of one line and day type that visit exactly the same stops and never overtake
+// each other. Stop times are stored twice: trip-major for walking along a boarded trip,
+// and stop-major so that "first trip leaving stop i at or after t" is a binary search
+// over one contiguous column.
+struct RoutePattern {
+    int32_t line_id = 0;
+    uint8_t route_day = 0;
+    std::vector<int32_t> stop_ids;           // stops in visiting order
+    std::vector<int32_t> trip_ordinals;      // departure_ordinal_number of each trip, earliest first
+    std::vector<int32_t> stop_times;         // stop_times[trip * stop_count() + position]
+    std::vector<int32_t> departures_by_stop; // departures_by_stop[position * trip_count() + trip]
+
+    size_t stop_count() const { return stop_ids.size(); }
+    size_t trip_count() const { return trip_ordinals.size(); }
+
+    int32_t time(size_t trip, size_t position) const { return stop_times[trip * stop_count() + position]; }
+    const int32_t *column(size_t position) const { return departures_by_stop.data() + position * trip_count(); }
+
+    // Index of the first trip leaving the stop at position at or after time, or -1
+    int first_trip_after(size_t position, int32_t time) const;
+    // Index of the last trip reaching the stop at position at or before time, or -1
+    int last_trip_before(size_t position, int32_t time) const;
+};
+
+// Function to group the departures of one line (sorted by route_day, departure_ordinal_number,
+// stop position) into patterns. Times of a trip that runs past midnight continue past 24:00.
+std::vector<std::shared_ptr<const RoutePattern>> build_route_patterns(int32_t line_id, const DepartureView &departures);
+
+#endif // ROUTE_PATTERNS_H
@@ -13,6 +13,10 @@
 #include <set>
 #include <algorithm>
 #include <map>
+#include "top_k.h"
+#include "database_queries.h"
+#include "latency.h"
+#include "calendar.h"
 
 // Function to encode URL
 std::string url_encode(const std::string &value) {
@@ -34,22 +38,9 @@ std::string url_encode(const std::string &value) {
 }
 
 // Function to categorize the date into "Roboczy", "Sobota", or "Niedziela i święta"
+// Public holidays count as "Niedziela i święta"; see calendar.h
 std::string categorize_date(const std::string &date_str) {
-    std::tm date = {};
-    std::istringstream ss(date_str);
-    ss >> std::get_time(&date, "%Y-%m-%d");
-    if (ss.fail()) {
-        throw std::runtime_error("Failed to parse date");
-    }
-
-    int weekday = date.tm_wday;
-    if (weekday >= 1 && weekday <= 5) {
-        return "Roboczy";
-    } else if (weekday == 6) {
-        return "Sobota";
-    } else {
-        return "Niedziela i święta";
-    }
+    return day_type_name(day_type_for_date(date_str));
 }
 
 // Callback function for cURL write
@@ -60,6 +51,7 @@ size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
 
 // Function to get coordinates from an address using Nominatim API
 Coordinates getCoordinates(const std::string &address) {
+    ScopedLatency timer(LatencyEndpoint::Geocode);
     CURL* curl;
     CURLcode res;
     std::string readBuffer;
@@ -123,244 +115,222 @@ double haversine(double lat1, double lon1, double lat2, double lon2) {
     return R * c;
 }
 
-// Function to get the nearest bus stops from a given location
-std::vector<BusStop> get_nearest_stops(pqxx::connection &conn, double latitude, double longitude, int size_of_response) {
-    pqxx::work txn(conn);
-    pqxx::result result = txn.exec("SELECT id, name, latitude, longitude FROM route_search_busstop");
-
+std::vector<BusStop> bus_stops_from_rows(const pqxx::result &result, const std::vector<std::pair<double, size_t>> &nearest) {
     std::vector<BusStop> bus_stops;
-    for (auto row : result) {
-        if (row["latitude"].is_null() || row["longitude"].is_null()) {
-            continue; // Skip rows with null latitude or longitude
-        }
-
+    for (const auto &entry : nearest) {
+        auto row = result[entry.second];
         BusStop stop;
         stop.id = row["id"].c_str();  // Add the id field
         stop.name = row["name"].c_str();
         stop.latitude = row["latitude"].as<double>();
         stop.longitude = row["longitude"].as<double>();
-        stop.distance = haversine(latitude, longitude, stop.latitude, stop.longitude);
+        stop.distance = entry.first;
         bus_stops.push_back(stop);
     }
-
-    std::sort(bus_stops.begin(), bus_stops.end(), [](const BusStop &a, const BusStop &b) {
-        return a.distance < b.distance;
-    });
-
-    if (bus_stops.size() > size_of_response) {
-        bus_stops.resize(size_of_response);
-    }
-
     return bus_stops;
 }
 
-std::vector<Solution> find_route_without_changing_bus(pqxx::connection &conn, const std::string &start_location, const std::string &goal_location, const std::string &date, const std::string &time) {
-    std::vector<Solution> solutions;
-    std::map<std::pair<std::string, std::string>, Solution> earliest_solutions;
-    std::string day_type = categorize_date(date);
-
-    Coordinates start_coords = getCoordinates(start_location);
-    Coordinates goal_coords = getCoordinates(goal_location);
+std::vector<std::pair<double, size_t>> within_walk(std::vector<std::pair<double, size_t>> nearest, const CandidateOptions &options) {
+    size_t min_count = static_cast<size_t>(std::max(options.min_count, 0));
+    size_t count = 0;
+    while (count < nearest.size() && (count < min_count || nearest[count].first <= options.max_walk_meters)) {
+        ++count;
+    }
+    nearest.resize(count);
+    return nearest;
+}
 
-    std::vector<BusStop> nearest_start_stops = get_nearest_stops(conn, start_coords.latitude, start_coords.longitude, 10);
-    std::vector<BusStop> nearest_goal_stops = get_nearest_stops(conn, goal_coords.latitude, goal_coords.longitude, 10);
+// Function to get the candidate stops of several locations with one scan of the stop table
+std::vector<std::vector<BusStop>> get_candidate_stops(pqxx::connection &conn, const std::vector<Coordinates> &locations, const CandidateOptions &options) {
+    pqxx::work txn(conn);
+    pqxx::result result = exec_timed(txn, "SELECT id, name, latitude, longitude FROM route_search_busstop");
 
-    for (const auto &start_stop : nearest_start_stops) {
-        pqxx::work txn(conn);
-        std::string query = "SELECT bl.name, bl.direction, bd1.time AS departure_time, bd2.time AS arrival_time, bd2.bus_stop_id AS goal_stop_id, "
-                            "bs1.ordinal_number AS start_ordinal, bs2.ordinal_number AS goal_ordinal "
-                            "FROM route_search_busline bl "
-                            "JOIN route_search_busdeparture bd1 ON bl.id = bd1.bus_line_id "
-                            "JOIN route_search_busdeparture bd2 ON bl.id = bd2.bus_line_id "
-                            "JOIN route_search_busstopinbusline bs1 ON bl.id = bs1.bus_line_id AND bd1.bus_stop_id = bs1.bus_stop_id "
-                            "JOIN route_search_busstopinbusline bs2 ON bl.id = bs2.bus_line_id AND bd2.bus_stop_id = bs2.bus_stop_id "
-                            "WHERE bd1.bus_stop_id = " + txn.quote(start_stop.id) + " "
-                            "AND bd1.time >= " + txn.quote(time) + " "
-                            "AND bd1.departure_ordinal_number = bd2.departure_ordinal_number "
-                            "AND bd1.route_day = " + txn.quote(day_type) + " "
-                            "ORDER BY bd1.time";
-        pqxx::result result = txn.exec(query);
-
-        for (auto row : result) {
-            std::string bus_line = row["name"].c_str();
-            std::string direction = row["direction"].c_str();
-            std::string departure_time = row["departure_time"].c_str();
-            std::string arrival_time = row["arrival_time"].c_str();
-            std::string goal_stop_id = row["goal_stop_id"].c_str();
-            int start_ordinal = row["start_ordinal"].as<int>();
-            int goal_ordinal = row["goal_ordinal"].as<int>();
-
-            if (start_ordinal < goal_ordinal) {
-                for (const auto &goal_stop : nearest_goal_stops) {
-                    if (goal_stop.id == goal_stop_id) {
-                        Solution sol;
-                        sol.bus_line = bus_line;
-                        sol.direction = direction;
-                        sol.departure_time = departure_time;
-                        sol.arrival_time = arrival_time;
-                        sol.start_stop = start_stop.name;
-                        sol.goal_stop = goal_stop.name;
-
-                        auto key = std::make_pair(bus_line, direction);
-                        if (earliest_solutions.find(key) == earliest_solutions.end() || sol.departure_time < earliest_solutions[key].departure_time) {
-                            earliest_solutions[key] = sol;
-                        }
-                    }
-                }
-            }
+    // Only the (distance, row) pairs are ranked; BusStops are built for the winners alone
+    std::vector<TopK<std::pair<double, size_t>>> nearest(locations.size(), TopK<std::pair<double, size_t>>(static_cast<size_t>(std::max(options.max_count, 0))));
+    for (size_t i = 0; i < result.size(); ++i) {
+        auto row = result[i];
+        if (row["latitude"].is_null() || row["longitude"].is_null()) {
+            continue; // Skip rows with null latitude or longitude
+        }
+        double latitude = row["latitude"].as<double>();
+        double longitude = row["longitude"].as<double>();
+        for (size_t l = 0; l < locations.size(); ++l) {
+            nearest[l].push({haversine(locations[l].latitude, locations[l].longitude, latitude, longitude), i});
         }
     }
 
-    for (const auto &entry : earliest_solutions) {
-        solutions.push_back(entry.second);
+    std::vector<std::vector<BusStop>> bus_stops;
+    for (auto &selection : nearest) {
+        bus_stops.push_back(bus_stops_from_rows(result, within_walk(selection.take_sorted(), options)));
     }
-
-    return solutions;
+    return bus_stops;
 }
 
+QueryContext make_query_context(pqxx::connection &conn, const std::string &date, const std::string &time, Coordinates start_coords, Coordinates goal_coords) {
+    QueryContext context;
+    context.date = date;
+    context.time = time;
+    context.day_type = categorize_date(date);
+    context.start_coords = start_coords;
+    context.goal_coords = goal_coords;
+
+    std::vector<std::vector<BusStop>> nearest = get_candidate_stops(conn, {start_coords, goal_coords}, QUERY_CANDIDATE_OPTIONS);
+    context.start_stops = std::move(nearest[0]);
+    context.goal_stops = std::move(nearest[1]);
+    return context;
+}
 
+QueryContext make_query_context(pqxx::connection &conn, const std::string &start_location, const std::string &goal_location, const std::string &date, const std::string &time) {
+    return make_query_context(conn, date, time, getCoordinates(start_location), getCoordinates(goal_location));
+}
 
-std::vector<std::variant<Solution, SolutionTwoBuses>> find_route_with_changing_bus(pqxx::connection &conn, const std::string &start_location, const std::string &goal_location, const std::string &date, const std::string &time, const std::set<std::string> &used_buses) {
-    std::vector<std::variant<Solution, SolutionTwoBuses>> solutions;
-    std::map<std::pair<std::string, std::string>, SolutionTwoBuses> earliest_solutions;
-    std::string day_type = categorize_date(date);
-
-    Coordinates start_coords = getCoordinates(start_location);
-    Coordinates goal_coords = getCoordinates(goal_location);
-
-    std::cout << "Start Coordinates: Latitude = " << start_coords.latitude << ", Longitude = " << start_coords.longitude << std::endl;
-    std::cout << "Goal Coordinates: Latitude = " << goal_coords.latitude << ", Longitude = " << goal_coords.longitude << std::endl;
-
-    std::vector<BusStop> nearest_start_stops = get_nearest_stops(conn, start_coords.latitude, start_coords.longitude, 10);
-    std::vector<BusStop> nearest_goal_stops = get_nearest_stops(conn, goal_coords.latitude, goal_coords.longitude, 10);
-    std::set<std::pair<std::string, std::string>> first_bus_list;
-    
-    for (const auto &start_stop : nearest_start_stops) {
-        pqxx::work txn(conn);
-        std::string query = "SELECT bl.name, bl.direction, bd1.time AS departure_time, bd2.time AS arrival_time, bd2.bus_stop_id AS second_stop_id, "
-                            "bs1.ordinal_number AS start_ordinal, bs2.ordinal_number AS goal_ordinal "
-                            "FROM route_search_busline bl "
-                            "JOIN route_search_busdeparture bd1 ON bl.id = bd1.bus_line_id "
-                            "JOIN route_search_busdeparture bd2 ON bl.id = bd2.bus_line_id "
-                            "JOIN route_search_busstopinbusline bs1 ON bl.id = bs1.bus_line_id AND bd1.bus_stop_id = bs1.bus_stop_id "
-                            "JOIN route_search_busstopinbusline bs2 ON bl.id = bs2.bus_line_id AND bd2.bus_stop_id = bs2.bus_stop_id "
-                            "WHERE bd1.bus_stop_id = " + txn.quote(start_stop.id) + " "
-                            "AND bd1.time >= " + txn.quote(time) + " "
-                            "AND bd1.departure_ordinal_number = bd2.departure_ordinal_number "
-                            "AND bd1.route_day = " + txn.quote(day_type) + " "
-                            "ORDER BY bd1.time";
-        pqxx::result result = txn.exec(query);
-
-        for (auto row : result) {
-            std::string bus_line = row["name"].c_str();
-            std::string direction = row["direction"].c_str();
-            std::string departure_time = row["departure_time"].c_str();
-            std::string arrival_time = row["arrival_time"].c_str();
-            std::string second_stop_id = row["second_stop_id"].c_str();
-            int start_ordinal = row["start_ordinal"].as<int>();
-            int goal_ordinal = row["goal_ordinal"].as<int>();
-            bool goal_station = false;
-            first_bus_list.insert({bus_line, direction});
-
-            if (start_ordinal < goal_ordinal && used_buses.find(bus_line) == used_buses.end()) {
-                for (const auto &goal_stop : nearest_goal_stops) {
-                    if (goal_stop.id == second_stop_id) {
-                        goal_station = true;
-                        SolutionTwoBuses solTwoBuses;
-                        solTwoBuses.bus_line = bus_line;
-                        solTwoBuses.direction = direction;
-                        solTwoBuses.departure_time = departure_time;
-                        solTwoBuses.arrival_time = arrival_time;
-                        solTwoBuses.start_stop = start_stop.name;
-                        solTwoBuses.goal_stop = goal_stop.name;
-
-                        auto key = std::make_pair(bus_line, direction);
-                        if (earliest_solutions.find(key) == earliest_solutions.end() || solTwoBuses.departure_time < earliest_solutions[key].departure_time) {
-                            earliest_solutions[key] = solTwoBuses;
-                        }
-                    }
-                }
+pqxx::result query_first_legs(pqxx::transaction_base &txn, const std::string &stop_id, const std::string &time, const std::string &day_type) {
+    std::string query = "SELECT bl.name, bl.direction, bd1.time AS departure_time, bd2.time AS arrival_time, bd2.bus_stop_id AS second_stop_id, "
+                        "bs1.ordinal_number AS start_ordinal, bs2.ordinal_number AS goal_ordinal "
+                        "FROM route_search_busline bl "
+                        "JOIN route_search_busdeparture bd1 ON bl.id = bd1.bus_line_id "
+                        "JOIN route_search_busdeparture bd2 ON bl.id = bd2.bus_line_id "
+                        "JOIN route_search_busstopinbusline bs1 ON bl.id = bs1.bus_line_id AND bd1.bus_stop_id = bs1.bus_stop_id "
+                        "JOIN route_search_busstopinbusline bs2 ON bl.id = bs2.bus_line_id AND bd2.bus_stop_id = bs2.bus_stop_id "
+                        "WHERE bd1.bus_stop_id = " + txn.quote(stop_id) + " "
+                        "AND bd1.time >= " + txn.quote(time) + " "
+                        "AND bd1.departure_ordinal_number = bd2.departure_ordinal_number "
+                        "AND bd1.route_day = " + txn.quote(day_type) + " "
+                        "ORDER BY bd1.time";
+    return exec_timed(txn, query);
+}
 
-                if (!goal_station) {
-                    std::string query_second_bus = "SELECT bl.name, bl.direction, bd1.time AS departure_time, bd2.time AS arrival_time, bd2.bus_stop_id AS second_stop_id, "
+pqxx::result query_second_legs(pqxx::transaction_base &txn, const std::string &stop_id, const std::string &bus_line, const std::string &time, const std::string &day_type) {
+    std::string query = "SELECT bl.name, bl.direction, bd1.time AS departure_time, bd2.time AS arrival_time, bd2.bus_stop_id AS second_stop_id, "
                         "bs1.ordinal_number AS start_ordinal, bs2.ordinal_number AS goal_ordinal "
                         "FROM route_search_busline bl "
                         "JOIN route_search_busdeparture bd1 ON bl.id = bd1.bus_line_id "
                         "JOIN route_search_busdeparture bd2 ON bl.id = bd2.bus_line_id "
                         "JOIN route_search_busstopinbusline bs1 ON bl.id = bs1.bus_line_id AND bd1.bus_stop_id = bs1.bus_stop_id "
                         "JOIN route_search_busstopinbusline bs2 ON bl.id = bs2.bus_line_id AND bd2.bus_stop_id = bs2.bus_stop_id "
-                        "WHERE bd1.bus_stop_id = " + txn.quote(second_stop_id) + " "
+                        "WHERE bd1.bus_stop_id = " + txn.quote(stop_id) + " "
                         "AND bl.name != " + txn.quote(bus_line) + " "
-                        "AND bd1.time >= " + txn.quote(arrival_time) + " "
+                        "AND bd1.time >= " + txn.quote(time) + " "
                         "AND bd1.departure_ordinal_number = bd2.departure_ordinal_number "
                         "AND bd1.route_day = " + txn.quote(day_type) + " "
                         "ORDER BY bd1.time";
-                    pqxx::result result_second_bus = txn.exec(query_second_bus);
-
-                    for (auto row : result_second_bus) {
-                        std::string second_bus_line = row["name"].c_str();
-                        std::string second_direction = row["direction"].c_str();
-                        std::string second_departure_time = row["departure_time"].c_str();
-                        std::string second_arrival_time = row["arrival_time"].c_str();
-                        std::string third_stop_id = row["second_stop_id"].c_str();
-                        int second_start_ordinal = row["start_ordinal"].as<int>();
-                        int second_goal_ordinal = row["goal_ordinal"].as<int>();
-                        bool second_goal_station = false;
-
-                        if (first_bus_list.find({second_bus_line, second_direction}) == first_bus_list.end() && used_buses.find(second_bus_line) == used_buses.end()) {
-                            for (const auto &goal_stop : nearest_goal_stops) {
-                                if (goal_stop.id == third_stop_id) {
-                                    second_goal_station = true;
-
-                                    SolutionTwoBuses solTwoBuses;
-                                    solTwoBuses.bus_line = bus_line;
-                                    solTwoBuses.direction = direction;
-                                    solTwoBuses.departure_time = departure_time;
-                                    solTwoBuses.arrival_time = arrival_time;
-                                    solTwoBuses.start_stop = start_stop.name;
-                                    solTwoBuses.goal_stop = second_stop_id;
-
-                                    solTwoBuses.second_bus_line = second_bus_line;
-                                    solTwoBuses.second_departure_time = second_departure_time;
-                                    solTwoBuses.second_arrival_time = second_arrival_time;
-                                    solTwoBuses.second_start_stop = second_stop_id;
-                                    solTwoBuses.second_goal_stop = goal_stop.name;
-                                    solTwoBuses.second_direction = second_direction;
-
-                                    auto second_key = std::make_pair(second_bus_line, second_direction);
-                                    if (earliest_solutions.find(second_key) == earliest_solutions.end() || solTwoBuses.second_departure_time < earliest_solutions[second_key].second_departure_time) {
-                                        earliest_solutions[second_key] = solTwoBuses;
-                                    }
-                                }
-                            }
-                        }
-                    }
+    return exec_timed(txn, query);
+}
+
+void FusedRouteSearch::add_first_legs(const BusStop &start_stop, const pqxx::result &result) {
+    for (auto row : result) {
+        FirstLegRow leg{row["name"].c_str(), row["direction"].c_str(), row["departure_time"].c_str(), row["arrival_time"].c_str(),
+                     row["second_stop_id"].c_str(), start_stop.name, row_count++};
+        first_bus_rows.emplace(std::make_pair(leg.bus_line, leg.direction), leg.row_index);
+        if (row["start_ordinal"].as<int>() >= row["goal_ordinal"].as<int>()) {
+            continue;
+        }
+
+        bool goal_station = false;
+        for (const auto &goal_stop : context.goal_stops) {
+            if (goal_stop.id == leg.second_stop_id) {
+                goal_station = true;
+                Solution sol;
+                sol.bus_line = leg.bus_line;
+                sol.direction = leg.direction;
+                sol.departure_time = leg.departure_time;
+                sol.arrival_time = leg.arrival_time;
+                sol.start_stop = start_stop.name;
+                sol.goal_stop = goal_stop.name;
+
+                auto key = std::make_pair(leg.bus_line, leg.direction);
+                auto existing = earliest_direct.find(key);
+                if (existing == earliest_direct.end() || sol.departure_time < existing->second.departure_time) {
+                    earliest_direct[key] = sol;
                 }
+                used_buses.insert(leg.bus_line);
             }
         }
+        // A ride reaching a goal stop makes its line a direct solution, so it is never expanded
+        if (!goal_station) {
+            seeds.push_back(std::move(leg));
+        }
     }
+}
 
-    for (const auto &entry : earliest_solutions) {
-        solutions.push_back(entry.second);
+std::vector<FirstLegRow> FusedRouteSearch::seeds_to_expand() const {
+    std::vector<FirstLegRow> expand;
+    for (const FirstLegRow &leg : seeds) {
+        if (used_buses.find(leg.bus_line) == used_buses.end()) {
+            expand.push_back(leg);
+        }
     }
-
-    return solutions;
+    return expand;
 }
 
-std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes(pqxx::connection &conn, const std::string &start_location, const std::string &goal_location, const std::string &date, const std::string &time) {
-    std::vector<Solution> solutions_without_changing_bus = find_route_without_changing_bus(conn, start_location, goal_location, date, time);
+void FusedRouteSearch::add_second_legs(const FirstLegRow &leg, const pqxx::result &result) {
+    for (auto row : result) {
+        std::string second_bus_line = row["name"].c_str();
+        std::string second_direction = row["direction"].c_str();
+        std::string third_stop_id = row["second_stop_id"].c_str();
 
-    // Collect used bus lines
-    std::set<std::string> used_buses;
-    for (const auto &sol : solutions_without_changing_bus) {
-        used_buses.insert(sol.bus_line);
+        auto seen = first_bus_rows.find({second_bus_line, second_direction});
+        if ((seen != first_bus_rows.end() && seen->second <= leg.row_index) || used_buses.find(second_bus_line) != used_buses.end()) {
+            continue;
+        }
+        for (const auto &goal_stop : context.goal_stops) {
+            if (goal_stop.id == third_stop_id) {
+                SolutionTwoBuses solTwoBuses;
+                solTwoBuses.bus_line = leg.bus_line;
+                solTwoBuses.direction = leg.direction;
+                solTwoBuses.departure_time = leg.departure_time;
+                solTwoBuses.arrival_time = leg.arrival_time;
+                solTwoBuses.start_stop = leg.start_stop_name;
+                solTwoBuses.goal_stop = leg.second_stop_id;
+
+                solTwoBuses.second_bus_line = second_bus_line;
+                solTwoBuses.second_departure_time = row["departure_time"].c_str();
+                solTwoBuses.second_arrival_time = row["arrival_time"].c_str();
+                solTwoBuses.second_start_stop = leg.second_stop_id;
+                solTwoBuses.second_goal_stop = goal_stop.name;
+                solTwoBuses.second_direction = second_direction;
+
+                auto second_key = std::make_pair(second_bus_line, second_direction);
+                auto existing = earliest_two_buses.find(second_key);
+                if (existing == earliest_two_buses.end() || solTwoBuses.second_departure_time < existing->second.second_departure_time) {
+                    earliest_two_buses[second_key] = solTwoBuses;
+                }
+            }
+        }
     }
+}
 
+std::vector<std::variant<Solution, SolutionTwoBuses>> FusedRouteSearch::solutions() const {
     std::vector<std::variant<Solution, SolutionTwoBuses>> all_solutions;
-    all_solutions.insert(all_solutions.end(), solutions_without_changing_bus.begin(), solutions_without_changing_bus.end());
+    for (const auto &entry : earliest_direct) {
+        all_solutions.push_back(entry.second);
+    }
+    for (const auto &entry : earliest_two_buses) {
+        all_solutions.push_back(entry.second);
+    }
+    return all_solutions;
+}
+
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes_fused(pqxx::connection &conn, const QueryContext &context) {
+    FusedRouteSearch search(context);
+    for (const auto &start_stop : context.start_stops) {
+        pqxx::work txn(conn);
+        search.add_first_legs(start_stop, query_first_legs(txn, start_stop.id, context.time, context.day_type));
+    }
 
-    std::vector<std::variant<Solution, SolutionTwoBuses>> solutions_with_changing_bus = find_route_with_changing_bus(conn, start_location, goal_location, date, time, used_buses);
-    all_solutions.insert(all_solutions.end(), solutions_with_changing_bus.begin(), solutions_with_changing_bus.end());
+    pqxx::work txn(conn);
+    for (const FirstLegRow &leg : search.seeds_to_expand()) {
+        search.add_second_legs(leg, query_second_legs(txn, leg.second_stop_id, leg.bus_line, leg.arrival_time, context.day_type));
+    }
+    return search.solutions();
+}
 
-    return all_solutions;
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes(pqxx::connection &conn, const std::string &start_location, const std::string &goal_location, const std::string &date, const std::string &time) {
+    ScopedLatency timer(LatencyEndpoint::FindRoutes);
+    QueryContext context = make_query_context(conn, start_location, goal_location, date, time);
+
+    std::cout << "Start Coordinates: Latitude = " << context.start_coords.latitude << ", Longitude = " << context.start_coords.longitude << std::endl;
+    std::cout << "Goal Coordinates: Latitude = " << context.goal_coords.latitude << ", Longitude = " << context.goal_coords.longitude << std::endl;
+
+    return find_routes_fused(conn, context);
 }
@@ -3,8 +3,14 @@
 
 #include <string>
 #include <vector>
+#include <set>
+#include <variant>
+#include <map>
+#include <memory>
 #include <pqxx/pqxx>
 
+struct TimetableSnapshot;
+
 // Define the Solution struct if not already defined
 struct Solution {
     std::string bus_line;
@@ -45,10 +51,94 @@ struct BusStop {
     double distance; 
 };
 
+// Which stops to consider walking to: every stop within max_walk_meters, but never fewer
+// than min_count (the nearest ones, however far) nor more than max_count (the nearest ones)
+struct CandidateOptions {
+    double max_walk_meters = 800.0;
+    int min_count = 3;
+    int max_count = 20;
+};
+
+// Everything the search phases of one query share: computed once before the first
+// timetable lookup instead of once per phase
+struct QueryContext {
+    std::string date;
+    std::string time;
+    std::string day_type;
+    Coordinates start_coords;
+    Coordinates goal_coords;
+    std::vector<BusStop> start_stops; // nearest first
+    std::vector<BusStop> goal_stops;
+    // Optional, lets a router prune with the in-memory indices; has to match the database
+    std::shared_ptr<const TimetableSnapshot> snapshot;
+};
+
+// Candidate stops per endpoint used by the SQL routers: the stops within a walk, but at
+// least 3 and at most 10, so a far stop only gets a first-leg query when nothing is close
+const CandidateOptions QUERY_CANDIDATE_OPTIONS = {800.0, 3, 10};
+
 std::string categorize_date(const std::string& date_str);
 Coordinates getCoordinates(const std::string& address);
-std::vector<BusStop> get_nearest_stops(pqxx::connection &conn, double latitude, double longitude, int size_of_response);
-std::vector<Solution> find_route_without_changing_bus(pqxx::connection &conn, const std::string &start_location, const std::string &goal_location, const std::string &date, const std::string &time);
-std::vector<std::variant<Solution, SolutionTwoBuses>> find_route_with_changing_bus(pqxx::connection &conn, const std::string &start_location, const std::string &goal_location, const std::string &date, const std::string &time);
+double haversine(double lat1, double lon1, double lat2, double lon2);
+// Function to turn ranked (distance, row) pairs of a route_search_busstop result into stops
+std::vector<BusStop> bus_stops_from_rows(const pqxx::result &result, const std::vector<std::pair<double, size_t>> &nearest);
+// Function to cut (distance, row) pairs, nearest first and at most options.max_count of them,
+// down to the ones worth walking to under options
+std::vector<std::pair<double, size_t>> within_walk(std::vector<std::pair<double, size_t>> nearest, const CandidateOptions &options);
+// The candidate stops of each location under options, nearest first
+std::vector<std::vector<BusStop>> get_candidate_stops(pqxx::connection &conn, const std::vector<Coordinates> &locations, const CandidateOptions &options);
+// Function to geocode both endpoints (unless given), categorize the date and pick the
+// candidate stops of both endpoints (QUERY_CANDIDATE_OPTIONS) in one scan of the stop table
+QueryContext make_query_context(pqxx::connection &conn, const std::string &date, const std::string &time, Coordinates start_coords, Coordinates goal_coords);
+QueryContext make_query_context(pqxx::connection &conn, const std::string &start_location, const std::string &goal_location, const std::string &date, const std::string &time);
+
+// A forward ride from a candidate start stop, read once from a first-leg query by the fused
+// search and kept until every direct solution is known, then expanded with a second bus
+struct FirstLegRow {
+    std::string bus_line;
+    std::string direction;
+    std::string departure_time;
+    std::string arrival_time;
+    std::string second_stop_id;
+    std::string start_stop_name;
+    size_t row_index; // position among all first-leg rows, in query order
+};
+
+// Rides of every trip leaving stop_id at or after time, joined with every stop of the same trip
+pqxx::result query_first_legs(pqxx::transaction_base &txn, const std::string &stop_id, const std::string &time, const std::string &day_type);
+// Same, leaving the transfer stop on a line other than bus_line
+pqxx::result query_second_legs(pqxx::transaction_base &txn, const std::string &stop_id, const std::string &bus_line, const std::string &time, const std::string &day_type);
+
+// Direct and one-change search in one pass over the first-leg rows: each row is read once,
+// giving a direct solution if it reaches a goal stop and a transfer seed otherwise. Seeds are
+// expanded once every start stop is in, since lines with a direct solution are not expanded.
+// Rows must be added in query order (start stops in context order), which keeps the answer
+// the same however the queries themselves are run.
+class FusedRouteSearch {
+public:
+    explicit FusedRouteSearch(const QueryContext &context) : context(context) {}
+
+    // Function to consume the rows of query_first_legs for the next start stop
+    void add_first_legs(const BusStop &start_stop, const pqxx::result &result);
+    // Seeds that need a second bus; valid once every start stop has been added
+    std::vector<FirstLegRow> seeds_to_expand() const;
+    // Function to consume the rows of query_second_legs for a seed, seeds in the order given
+    void add_second_legs(const FirstLegRow &leg, const pqxx::result &result);
+
+    std::vector<std::variant<Solution, SolutionTwoBuses>> solutions() const;
+
+private:
+    const QueryContext &context;
+    std::map<std::pair<std::string, std::string>, Solution> earliest_direct;
+    std::map<std::pair<std::string, std::string>, SolutionTwoBuses> earliest_two_buses;
+    // (line, direction) -> first first-leg row it appeared in; a second bus is only taken on
+    // lines not seen among the first-leg rows up to the one being expanded
+    std::map<std::pair<std::string, std::string>, size_t> first_bus_rows;
+    std::vector<FirstLegRow> seeds;
+    std::set<std::string> used_buses;
+    size_t row_count = 0;
+};
+
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes_fused(pqxx::connection &conn, const QueryContext &context);
 std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes(pqxx::connection &conn, const std::string &start_location, const std::string &goal_location, const std::string &date, const std::string &time);
 #endif // SEQUENCE_H
@@ -0,0 +1,287 @@
+#include <iostream>
+#include <algorithm>
+#include "snapshot.h"
+
+// Function to wrap every stop of an image
+static std::map<int32_t, std::shared_ptr<const StopInfo>> build_stops(const Timetable &timetable) {
+    std::map<int32_t, std::shared_ptr<const StopInfo>> stops;
+    for (size_t i = 0; i < timetable.stop_count; ++i) {
+        auto stop = std::make_shared<StopInfo>();
+        stop->record = &timetable.stops[i];
+        stop->name = timetable.stop_name(i);
+        stop->storage = timetable.storage;
+        stops.emplace(stop->record->id, stop);
+    }
+    return stops;
+}
+
+// Function to cut an image into lines; stop sequences and departures are already grouped by line
+static std::map<int32_t, std::shared_ptr<const LineTimetable>> build_lines(const Timetable &timetable) {
+    std::vector<std::shared_ptr<LineTimetable>> built_lines;
+    size_t sequence_index = 0;
+    size_t departure_index = 0;
+    const DepartureView &departures = timetable.departures;
+
+    for (size_t i = 0; i < timetable.line_count; ++i) {
+        auto line = std::make_shared<LineTimetable>();
+        line->id = timetable.lines[i].id;
+        line->name = timetable.line_name(i);
+        line->direction = timetable.line_direction(i);
+        line->storage = timetable.storage;
+
+        // Rows of lines missing from route_search_busline are skipped
+        while (sequence_index < timetable.stop_in_line_count && timetable.stops_in_lines[sequence_index].bus_line_id < line->id) {
+            ++sequence_index;
+        }
+        line->stops = timetable.stops_in_lines + sequence_index;
+        while (sequence_index < timetable.stop_in_line_count && timetable.stops_in_lines[sequence_index].bus_line_id == line->id) {
+            ++sequence_index;
+        }
+        line->stop_count = static_cast<size_t>(timetable.stops_in_lines + sequence_index - line->stops);
+
+        while (departure_index < departures.count && departures.bus_line_id[departure_index] < line->id) {
+            ++departure_index;
+        }
+        size_t first_departure = departure_index;
+        while (departure_index < departures.count && departures.bus_line_id[departure_index] == line->id) {
+            ++departure_index;
+        }
+        line->departures.id = departures.id + first_departure;
+        line->departures.bus_line_id = departures.bus_line_id + first_departure;
+        line->departures.bus_stop_id = departures.bus_stop_id + first_departure;
+        line->departures.departure_ordinal_number = departures.departure_ordinal_number + first_departure;
+        line->departures.time = departures.time + first_departure;
+        line->departures.route_day = departures.route_day + first_departure;
+        line->departures.count = departure_index - first_departure;
+
+        built_lines.push_back(line);
+    }
+
+    // Lines are independent, so their trips are grouped into patterns in parallel
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t i = 0; i < built_lines.size(); ++i) {
+        built_lines[i]->patterns = build_route_patterns(built_lines[i]->id, built_lines[i]->departures);
+    }
+
+    std::map<int32_t, std::shared_ptr<const LineTimetable>> lines;
+    for (auto &line : built_lines) {
+        lines.emplace(line->id, line);
+    }
+    return lines;
+}
+
+// Function to list the distinct stops of a line
+static std::vector<int32_t> line_stop_ids(const LineTimetable &line) {
+    std::vector<int32_t> stop_ids;
+    for (size_t i = 0; i < line.stop_count; ++i) {
+        stop_ids.push_back(line.stops[i].bus_stop_id);
+    }
+    std::sort(stop_ids.begin(), stop_ids.end());
+    stop_ids.erase(std::unique(stop_ids.begin(), stop_ids.end()), stop_ids.end());
+    return stop_ids;
+}
+
+// Function to (re)build the day partitions of the given day types from the patterns of every line
+static void build_partitions(TimetableSnapshot &snapshot, const bool (&days)[DAY_TYPE_COUNT]) {
+    std::vector<std::shared_ptr<const RoutePattern>> all_patterns;
+    for (const auto &entry : snapshot.lines) {
+        all_patterns.insert(all_patterns.end(), entry.second->patterns.begin(), entry.second->patterns.end());
+    }
+
+    #pragma omp parallel for
+    for (int day = 0; day < DAY_TYPE_COUNT; ++day) {
+        if (days[day]) {
+            snapshot.partitions[day] = build_day_partition(static_cast<DayType>(day), all_patterns);
+        }
+    }
+}
+
+std::shared_ptr<const TimetableSnapshot> make_snapshot(const Timetable &timetable, uint64_t version) {
+    auto snapshot = std::make_shared<TimetableSnapshot>();
+    snapshot->stops = build_stops(timetable);
+    snapshot->lines = build_lines(timetable);
+    snapshot->version = version;
+
+    std::map<int32_t, std::vector<int32_t>> stop_lines;
+    for (const auto &entry : snapshot->lines) {
+        for (int32_t stop_id : line_stop_ids(*entry.second)) {
+            stop_lines[stop_id].push_back(entry.first); // lines are visited in id order
+        }
+    }
+    for (auto &entry : stop_lines) {
+        snapshot->stop_lines.emplace(entry.first, std::make_shared<const std::vector<int32_t>>(std::move(entry.second)));
+    }
+
+    bool every_day[DAY_TYPE_COUNT];
+    std::fill(std::begin(every_day), std::end(every_day), true);
+    build_partitions(*snapshot, every_day);
+    snapshot->transfers = build_transfer_table(snapshot->lines);
+    snapshot->stop_index = std::make_shared<const StopIndex>(build_stop_index(*snapshot));
+    return snapshot;
+}
+
+std::shared_ptr<const TimetableSnapshot> apply_delta(const TimetableSnapshot &base, const Timetable &changed_rows, const ChangeSet &changes, uint64_t version) {
+    // Copies only the maps of pointers; the stops and lines themselves are shared
+    auto snapshot = std::make_shared<TimetableSnapshot>(base);
+    snapshot->version = version;
+
+    std::map<int32_t, std::shared_ptr<const StopInfo>> new_stops = build_stops(changed_rows);
+    for (int32_t stop_id : changes.stops) {
+        auto it = new_stops.find(stop_id);
+        if (it != new_stops.end()) {
+            snapshot->stops[stop_id] = it->second;
+        } else {
+            snapshot->stops.erase(stop_id);
+        }
+    }
+
+    // Stops whose line lists have to be patched: every stop of an old or new version of a changed line
+    std::map<int32_t, std::shared_ptr<const LineTimetable>> new_lines = build_lines(changed_rows);
+    std::map<int32_t, std::vector<int32_t>> touched_stop_lines;
+    auto touch = [&](int32_t stop_id) -> std::vector<int32_t> & {
+        auto touched = touched_stop_lines.find(stop_id);
+        if (touched != touched_stop_lines.end()) {
+            return touched->second;
+        }
+        auto existing = snapshot->stop_lines.find(stop_id);
+        std::vector<int32_t> line_ids;
+        if (existing != snapshot->stop_lines.end()) {
+            line_ids = *existing->second;
+        }
+        return touched_stop_lines.emplace(stop_id, std::move(line_ids)).first->second;
+    };
+
+    // Day types with a pattern of an old or new version of a changed line
+    bool changed_days[DAY_TYPE_COUNT] = {};
+    auto mark_days = [&](const LineTimetable &line) {
+        for (const auto &pattern : line.patterns) {
+            if (pattern->route_day < DAY_TYPE_COUNT) {
+                changed_days[pattern->route_day] = true;
+            }
+        }
+    };
+
+    for (int32_t line_id : changes.lines) {
+        auto old_line = snapshot->lines.find(line_id);
+        if (old_line != snapshot->lines.end()) {
+            mark_days(*old_line->second);
+            for (int32_t stop_id : line_stop_ids(*old_line->second)) {
+                std::vector<int32_t> &line_ids = touch(stop_id);
+                line_ids.erase(std::remove(line_ids.begin(), line_ids.end(), line_id), line_ids.end());
+            }
+            snapshot->lines.erase(old_line);
+        }
+
+        auto new_line = new_lines.find(line_id);
+        if (new_line != new_lines.end()) {
+            mark_days(*new_line->second);
+            for (int32_t stop_id : line_stop_ids(*new_line->second)) {
+                std::vector<int32_t> &line_ids = touch(stop_id);
+                line_ids.insert(std::lower_bound(line_ids.begin(), line_ids.end(), line_id), line_id);
+            }
+            snapshot->lines.emplace(line_id, new_line->second);
+        }
+    }
+
+    for (auto &entry : touched_stop_lines) {
+        if (entry.second.empty()) {
+            snapshot->stop_lines.erase(entry.first);
+        } else {
+            snapshot->stop_lines[entry.first] = std::make_shared<const std::vector<int32_t>>(std::move(entry.second));
+        }
+    }
+
+    // Partitions number stops and patterns densely, so a day type that lost or gained a
+    // pattern is re-indexed as a whole; the others are shared with base
+    if (!changes.lines.empty()) {
+        build_partitions(*snapshot, changed_days);
+        snapshot->transfers = patch_transfer_table(*base.transfers, snapshot->lines, snapshot->stop_lines, changes.lines);
+    }
+    if (!changes.stops.empty()) {
+        snapshot->stop_index = std::make_shared<const StopIndex>(build_stop_index(*snapshot));
+    }
+    return snapshot;
+}
+
+TimetableStore::TimetableStore(Loader loader, Patcher patcher) : loader(std::move(loader)), patcher(std::move(patcher)) {
+    reload();
+    reload_thread = std::thread(&TimetableStore::reload_loop, this);
+}
+
+TimetableStore::~TimetableStore() {
+    {
+        std::lock_guard<std::mutex> lock(reload_mutex);
+        stopping = true;
+    }
+    reload_condition.notify_all();
+    reload_thread.join();
+}
+
+std::shared_ptr<const TimetableSnapshot> TimetableStore::pin() const {
+    return std::atomic_load(&current);
+}
+
+void TimetableStore::publish(std::shared_ptr<const TimetableSnapshot> snapshot) {
+    // The previous snapshot lives on in the readers that pinned it
+    std::atomic_store(&current, std::move(snapshot));
+}
+
+void TimetableStore::reload() {
+    publish(make_snapshot(loader(), next_version.fetch_add(1)));
+}
+
+void TimetableStore::reload_async() {
+    ChangeSet everything;
+    everything.full = true;
+    apply_changes(everything);
+}
+
+void TimetableStore::apply_changes(const ChangeSet &changes) {
+    if (changes.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(reload_mutex);
+        pending_changes.merge(changes);
+    }
+    reload_condition.notify_all();
+}
+
+void TimetableStore::wait_for_reload() {
+    std::unique_lock<std::mutex> lock(reload_mutex);
+    reload_condition.wait(lock, [this]() { return pending_changes.empty() && !reload_running; });
+}
+
+// Function run by the background thread: one rebuild per batch of requests
+void TimetableStore::reload_loop() {
+    std::unique_lock<std::mutex> lock(reload_mutex);
+    while (true) {
+        reload_condition.wait(lock, [this]() { return !pending_changes.empty() || stopping; });
+        if (stopping) {
+            return;
+        }
+
+        ChangeSet changes = std::move(pending_changes);
+        pending_changes = ChangeSet();
+        reload_running = true;
+        lock.unlock();
+
+        try {
+            if (changes.full || !patcher) {
+                reload();
+            } else {
+                Timetable changed_rows = patcher(changes);
+                std::shared_ptr<const TimetableSnapshot> base = pin();
+                publish(apply_delta(*base, changed_rows, changes, next_version.fetch_add(1)));
+            }
+        } catch (const std::exception &e) {
+            // Keep serving the old snapshot
+            failed_reload_count.fetch_add(1);
+            std::cerr << "Timetable reload failed: " << e.what() << std::endl;
+        }
+
+        lock.lock();
+        reload_running = false;
+        reload_condition.notify_all();
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include "timetable.h"
+#include "route_patterns.h"
+#include "partition.h"
+#include "transfer_table.h"
+#include "nearest_stops.h"
+
+// One stop, pointing into the image it was loaded from
+struct StopInfo {
+    const StopRecord *record = nullptr;
+    std::string_view name;
+    std::shared_ptr<const void> storage;
+};
+
+// Stop sequence and departures of one line, pointing into the image it was loaded from.
+// A line is shared by every snapshot until the line itself changes (copy-on-write).
+struct LineTimetable {
+    int32_t id = 0;
+    std::string_view name;
+    std::string_view direction;
+    const StopInLineRecord *stops = nullptr; // ordinal order
+    size_t stop_count = 0;
+    DepartureView departures;                // sorted by (route_day, departure_ordinal_number, stop position)
+    std::shared_ptr<const void> storage;
+    std::vector<std::shared_ptr<const RoutePattern>> patterns;
+};
+
+// An immutable view of the network plus everything derived from it. Snapshots are
+// never modified after publication, so readers need no locking while they hold one.
+// Every entry is held by shared_ptr, so a new snapshot made by apply_delta shares
+// all untouched stops, lines and index entries with its predecessor.
+struct TimetableSnapshot {
+    std::map<int32_t, std::shared_ptr<const StopInfo>> stops;
+    std::map<int32_t, std::shared_ptr<const LineTimetable>> lines;
+    // stop id -> sorted ids of the lines that serve it
+    std::map<int32_t, std::shared_ptr<const std::vector<int32_t>>> stop_lines;
+    // Routing structures per day type, indexed by DayType
+    std::shared_ptr<const DayPartition> partitions[DAY_TYPE_COUNT];
+    // Stops where each pair of lines can be changed between
+    std::shared_ptr<const TransferTable> transfers;
+    // Stops by location, for picking the stops to walk to
+    std::shared_ptr<const StopIndex> stop_index;
+    uint64_t version = 0;
+
+    const DayPartition &partition(DayType day_type) const { return *partitions[static_cast<int>(day_type)]; }
+};
+
+// Builds a snapshot from a full timetable image
+std::shared_ptr<const TimetableSnapshot> make_snapshot(const Timetable &timetable, uint64_t version);
+
+// Builds the next snapshot from the previous one. changed_rows holds the current rows of
+// the stops and lines listed in changes (see load_timetable_changes); listed stops and
+// lines missing from it were deleted. Only the changed rows are fetched and turned into
+// stops, lines and patterns; everything else is shared with base. The maps of pointers
+// are copied, though, which is linear in the number of stops and lines (but touches no
+// departures). Only the transfer-table pairs from or to a changed line are recomputed.
+// A day partition numbers its stops and patterns densely, so it is rebuilt as a whole
+// (from the shared patterns) when a changed line runs on its day type. The stop index is
+// rebuilt only when stops changed.
+std::shared_ptr<const TimetableSnapshot> apply_delta(const TimetableSnapshot &base, const Timetable &changed_rows, const ChangeSet &changes, uint64_t version);
+
+// Holds the current snapshot and swaps in new ones RCU-style: readers pin the snapshot
+// they started with, a reload builds the next one in the background and publishes it
+// with one atomic pointer store, and the old snapshot is freed when its last reader
+// drops it. Queries are never blocked by a reload.
+class TimetableStore {
+public:
+    using Loader = std::function<Timetable()>;
+    // Loads the current rows of the stops/lines that changed, e.g. load_timetable_changes
+    using Patcher = std::function<Timetable(const ChangeSet &)>;
+
+    explicit TimetableStore(Loader loader, Patcher patcher = nullptr);
+    ~TimetableStore();
+
+    TimetableStore(const TimetableStore &) = delete;
+    TimetableStore &operator=(const TimetableStore &) = delete;
+
+    // Snapshot to use for one query; keep the pointer for the whole query
+    std::shared_ptr<const TimetableSnapshot> pin() const;
+
+    // Asks the background thread for a reload; requests arriving while one is running are coalesced
+    void reload_async();
+
+    // Asks the background thread to patch only what the changes touch (a full reload
+    // without a patcher); changes arriving while it runs are merged into the next patch
+    void apply_changes(const ChangeSet &changes);
+
+    // Blocks until no reload is pending or running
+    void wait_for_reload();
+
+    uint64_t failed_reloads() const { return failed_reload_count.load(); }
+
+private:
+    void publish(std::shared_ptr<const TimetableSnapshot> snapshot);
+
+    // Loads and publishes a new snapshot on the calling thread. Only the constructor and the
+    // reload thread call it, so a full reload never races a delta built from an older base.
+    void reload();
+
+    void reload_loop();
+
+    Loader loader;
+    Patcher patcher;
+    std::shared_ptr<const TimetableSnapshot> current;
+    std::atomic<uint64_t> next_version{1};
+    std::atomic<uint64_t> failed_reload_count{0};
+
+    std::mutex reload_mutex;
+    std::condition_variable reload_condition;
+    ChangeSet pending_changes;
+    bool reload_running = false;
+    bool stopping = false;
+    std::thread reload_thread;
+};
+
+#endif // SNAPSHOT_H
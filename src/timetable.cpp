@@ -0,0 +1,366 @@
+#include <iostream>
+#include <pqxx/pqxx>
+#include "timetable.h"
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+#include <set>
+#include <map>
+#include <limits>
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::string_view Timetable::stop_name(size_t stop_index) const {
+    return std::string_view(strings + stops[stop_index].name_offset, stops[stop_index].name_length);
+}
+
+std::string_view Timetable::line_name(size_t line_index) const {
+    return std::string_view(strings + lines[line_index].name_offset, lines[line_index].name_length);
+}
+
+std::string_view Timetable::line_direction(size_t line_index) const {
+    return std::string_view(strings + lines[line_index].direction_offset, lines[line_index].direction_length);
+}
+
+int Timetable::find_stop(int32_t stop_id) const {
+    const StopRecord *end = stops + stop_count;
+    const StopRecord *it = std::lower_bound(stops, end, stop_id, [](const StopRecord &stop, int32_t id) {
+        return stop.id < id;
+    });
+    return it != end && it->id == stop_id ? static_cast<int>(it - stops) : -1;
+}
+
+int Timetable::find_line(int32_t line_id) const {
+    const LineRecord *end = lines + line_count;
+    const LineRecord *it = std::lower_bound(lines, end, line_id, [](const LineRecord &line, int32_t id) {
+        return line.id < id;
+    });
+    return it != end && it->id == line_id ? static_cast<int>(it - lines) : -1;
+}
+
+void ChangeSet::merge(const ChangeSet &other) {
+    lines.insert(other.lines.begin(), other.lines.end());
+    stops.insert(other.stops.begin(), other.stops.end());
+    full = full || other.full;
+}
+
+// Function to append a string to the pool and return its offset
+static uint32_t intern_string(std::string &strings, std::string_view value) {
+    uint32_t offset = static_cast<uint32_t>(strings.size());
+    strings += value;
+    return offset;
+}
+
+// Function to point a Timetable at the sections of a validated image
+static Timetable bind_timetable(const char *image, size_t image_size, std::shared_ptr<const void> storage) {
+    if (image_size < sizeof(TimetableFileHeader)) {
+        throw std::runtime_error("Timetable image is too small");
+    }
+
+    TimetableFileHeader header;
+    std::memcpy(&header, image, sizeof(header));
+    if (std::memcmp(header.magic, TIMETABLE_MAGIC, sizeof(TIMETABLE_MAGIC)) != 0 ||
+        header.version != TIMETABLE_VERSION ||
+        header.header_size != sizeof(TimetableFileHeader) ||
+        header.image_size != image_size) {
+        throw std::runtime_error("Not a timetable image or written by an incompatible version");
+    }
+
+    auto section = [&](const TimetableSection &s, size_t element_size) {
+        if (s.offset % 8 != 0 || s.offset > image_size || s.count > (image_size - s.offset) / element_size) {
+            throw std::runtime_error("Timetable image section out of bounds");
+        }
+        return image + s.offset;
+    };
+
+    Timetable timetable;
+    timetable.stops = reinterpret_cast<const StopRecord *>(section(header.stops, sizeof(StopRecord)));
+    timetable.stop_count = header.stops.count;
+    timetable.lines = reinterpret_cast<const LineRecord *>(section(header.lines, sizeof(LineRecord)));
+    timetable.line_count = header.lines.count;
+    timetable.stops_in_lines = reinterpret_cast<const StopInLineRecord *>(section(header.stops_in_lines, sizeof(StopInLineRecord)));
+    timetable.stop_in_line_count = header.stops_in_lines.count;
+
+    size_t departure_count = header.departure_id.count;
+    for (const TimetableSection *column : {&header.departure_bus_line_id, &header.departure_bus_stop_id, &header.departure_ordinal_number, &header.departure_time, &header.departure_route_day}) {
+        if (column->count != departure_count) {
+            throw std::runtime_error("Timetable departure columns differ in length");
+        }
+    }
+    timetable.departures.id = reinterpret_cast<const int32_t *>(section(header.departure_id, sizeof(int32_t)));
+    timetable.departures.bus_line_id = reinterpret_cast<const int32_t *>(section(header.departure_bus_line_id, sizeof(int32_t)));
+    timetable.departures.bus_stop_id = reinterpret_cast<const int32_t *>(section(header.departure_bus_stop_id, sizeof(int32_t)));
+    timetable.departures.departure_ordinal_number = reinterpret_cast<const int32_t *>(section(header.departure_ordinal_number, sizeof(int32_t)));
+    timetable.departures.time = reinterpret_cast<const int32_t *>(section(header.departure_time, sizeof(int32_t)));
+    timetable.departures.route_day = reinterpret_cast<const uint8_t *>(section(header.departure_route_day, sizeof(uint8_t)));
+    timetable.departures.count = departure_count;
+
+    timetable.strings = section(header.strings, 1);
+    timetable.strings_size = header.strings.count;
+
+    // Names are read straight out of the mapping, so every one must lie inside the string pool
+    auto string_fits = [&](uint32_t offset, uint32_t length) {
+        return static_cast<uint64_t>(offset) + length <= timetable.strings_size;
+    };
+    for (size_t i = 0; i < timetable.stop_count; ++i) {
+        if (!string_fits(timetable.stops[i].name_offset, timetable.stops[i].name_length)) {
+            throw std::runtime_error("Timetable stop name out of bounds");
+        }
+    }
+    for (size_t i = 0; i < timetable.line_count; ++i) {
+        const LineRecord &line = timetable.lines[i];
+        if (!string_fits(line.name_offset, line.name_length) || !string_fits(line.direction_offset, line.direction_length)) {
+            throw std::runtime_error("Timetable line name out of bounds");
+        }
+    }
+
+    timetable.image = image;
+    timetable.image_size = image_size;
+    timetable.storage = std::move(storage);
+    return timetable;
+}
+
+Timetable build_timetable(std::vector<StopRecord> stops, std::vector<LineRecord> lines, std::vector<StopInLineRecord> stops_in_lines, const DepartureColumns &departures, const std::string &strings) {
+    std::sort(stops.begin(), stops.end(), [](const StopRecord &a, const StopRecord &b) {
+        return a.id < b.id;
+    });
+    std::sort(lines.begin(), lines.end(), [](const LineRecord &a, const LineRecord &b) {
+        return a.id < b.id;
+    });
+    std::sort(stops_in_lines.begin(), stops_in_lines.end(), [](const StopInLineRecord &a, const StopInLineRecord &b) {
+        return std::tie(a.bus_line_id, a.ordinal_number) < std::tie(b.bus_line_id, b.ordinal_number);
+    });
+
+    // Departures are kept in trip order so later stages can group them without sorting again.
+    // First group the rows of each trip (time only orders repeated visits of one stop)...
+    std::vector<size_t> order(departures.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return std::tie(departures.bus_line_id[a], departures.route_day[a], departures.departure_ordinal_number[a], departures.time[a], a) <
+               std::tie(departures.bus_line_id[b], departures.route_day[b], departures.departure_ordinal_number[b], departures.time[b], b);
+    });
+
+    // ...then put every trip in the stop order of its line: the k-th visit of a stop on a trip
+    // is the k-th occurrence of that stop in route_search_busstopinbusline. Rows at stops the
+    // line does not list go last.
+    std::map<std::pair<int32_t, int32_t>, std::vector<int32_t>> stop_ordinals; // (line, stop) -> ordinals, ascending
+    for (const StopInLineRecord &record : stops_in_lines) {
+        stop_ordinals[{record.bus_line_id, record.bus_stop_id}].push_back(record.ordinal_number);
+    }
+    std::vector<int32_t> stop_position(departures.size());
+    for (size_t first = 0; first < order.size();) {
+        size_t a = order[first];
+        size_t last = first;
+        std::map<int32_t, size_t> visits;
+        for (; last < order.size(); ++last) {
+            size_t row = order[last];
+            if (departures.bus_line_id[row] != departures.bus_line_id[a] || departures.route_day[row] != departures.route_day[a] ||
+                departures.departure_ordinal_number[row] != departures.departure_ordinal_number[a]) {
+                break;
+            }
+            auto ordinals = stop_ordinals.find({departures.bus_line_id[row], departures.bus_stop_id[row]});
+            size_t visit = visits[departures.bus_stop_id[row]]++;
+            stop_position[row] = ordinals != stop_ordinals.end() && visit < ordinals->second.size()
+                                     ? ordinals->second[visit]
+                                     : std::numeric_limits<int32_t>::max();
+        }
+        std::stable_sort(order.begin() + first, order.begin() + last, [&](size_t x, size_t y) {
+            return stop_position[x] < stop_position[y];
+        });
+        first = last;
+    }
+
+    TimetableFileHeader header = {};
+    std::memcpy(header.magic, TIMETABLE_MAGIC, sizeof(TIMETABLE_MAGIC));
+    header.version = TIMETABLE_VERSION;
+    header.header_size = sizeof(TimetableFileHeader);
+
+    size_t size = sizeof(TimetableFileHeader);
+    auto reserve = [&size](TimetableSection &section, size_t count, size_t element_size) {
+        size = (size + 7) & ~static_cast<size_t>(7);
+        section.offset = size;
+        section.count = count;
+        size += count * element_size;
+    };
+    reserve(header.stops, stops.size(), sizeof(StopRecord));
+    reserve(header.lines, lines.size(), sizeof(LineRecord));
+    reserve(header.stops_in_lines, stops_in_lines.size(), sizeof(StopInLineRecord));
+    reserve(header.departure_id, order.size(), sizeof(int32_t));
+    reserve(header.departure_bus_line_id, order.size(), sizeof(int32_t));
+    reserve(header.departure_bus_stop_id, order.size(), sizeof(int32_t));
+    reserve(header.departure_ordinal_number, order.size(), sizeof(int32_t));
+    reserve(header.departure_time, order.size(), sizeof(int32_t));
+    reserve(header.departure_route_day, order.size(), sizeof(uint8_t));
+    reserve(header.strings, strings.size(), 1);
+    header.image_size = size;
+
+    // uint64_t elements keep the buffer 8-byte aligned for the record sections
+    auto buffer = std::make_shared<std::vector<uint64_t>>((size + 7) / 8);
+    char *image = reinterpret_cast<char *>(buffer->data());
+
+    std::memcpy(image, &header, sizeof(header));
+    std::copy(stops.begin(), stops.end(), reinterpret_cast<StopRecord *>(image + header.stops.offset));
+    std::copy(lines.begin(), lines.end(), reinterpret_cast<LineRecord *>(image + header.lines.offset));
+    std::copy(stops_in_lines.begin(), stops_in_lines.end(), reinterpret_cast<StopInLineRecord *>(image + header.stops_in_lines.offset));
+    std::copy(strings.begin(), strings.end(), image + header.strings.offset);
+
+    auto scatter = [&](const TimetableSection &section, auto &column) {
+        using T = typename std::decay_t<decltype(column)>::value_type;
+        T *target = reinterpret_cast<T *>(image + section.offset);
+        for (size_t i = 0; i < order.size(); ++i) {
+            target[i] = column[order[i]];
+        }
+    };
+    scatter(header.departure_id, departures.id);
+    scatter(header.departure_bus_line_id, departures.bus_line_id);
+    scatter(header.departure_bus_stop_id, departures.bus_stop_id);
+    scatter(header.departure_ordinal_number, departures.departure_ordinal_number);
+    scatter(header.departure_time, departures.time);
+    scatter(header.departure_route_day, departures.route_day);
+
+    return bind_timetable(image, size, buffer);
+}
+
+// Function to format ids for an "IN (...)" list; they are integers, so inlining them is safe
+static std::string id_list(const std::set<int32_t> &ids) {
+    std::string list;
+    for (int32_t id : ids) {
+        if (!list.empty()) {
+            list += ',';
+        }
+        list += std::to_string(id);
+    }
+    return list;
+}
+
+static void load_stop_rows(pqxx::transaction_base &txn, const std::string &condition, std::vector<StopRecord> &stops, std::string &strings) {
+    pqxx::result stop_rows = exec_timed(txn, "SELECT id, name, latitude, longitude FROM route_search_busstop "
+                                             "WHERE latitude IS NOT NULL AND longitude IS NOT NULL" + condition);
+    for (auto row : stop_rows) {
+        StopRecord stop = {};
+        stop.id = row["id"].as<int32_t>();
+        stop.name_offset = intern_string(strings, row["name"].c_str());
+        stop.name_length = static_cast<uint32_t>(strings.size() - stop.name_offset);
+        stop.latitude = row["latitude"].as<double>();
+        stop.longitude = row["longitude"].as<double>();
+        stops.push_back(stop);
+    }
+}
+
+static void load_line_rows(pqxx::transaction_base &txn, const std::string &condition, std::vector<LineRecord> &lines, std::string &strings) {
+    pqxx::result line_rows = exec_timed(txn, "SELECT id, name, direction FROM route_search_busline WHERE TRUE" + condition);
+    for (auto row : line_rows) {
+        LineRecord line = {};
+        line.id = row["id"].as<int32_t>();
+        line.name_offset = intern_string(strings, row["name"].c_str());
+        line.name_length = static_cast<uint32_t>(strings.size() - line.name_offset);
+        line.direction_offset = intern_string(strings, row["direction"].c_str());
+        line.direction_length = static_cast<uint32_t>(strings.size() - line.direction_offset);
+        lines.push_back(line);
+    }
+}
+
+static void load_stop_in_line_rows(pqxx::transaction_base &txn, const std::string &condition, std::vector<StopInLineRecord> &stops_in_lines) {
+    pqxx::result sequence_rows = exec_timed(txn, "SELECT bus_line_id, bus_stop_id, ordinal_number FROM route_search_busstopinbusline "
+                                                 "WHERE bus_line_id IS NOT NULL AND bus_stop_id IS NOT NULL AND ordinal_number IS NOT NULL" + condition);
+    for (auto row : sequence_rows) {
+        StopInLineRecord stop_in_line;
+        stop_in_line.bus_line_id = row["bus_line_id"].as<int32_t>();
+        stop_in_line.bus_stop_id = row["bus_stop_id"].as<int32_t>();
+        stop_in_line.ordinal_number = row["ordinal_number"].as<int32_t>();
+        stops_in_lines.push_back(stop_in_line);
+    }
+}
+
+Timetable load_timetable(pqxx::connection &conn) {
+    std::vector<StopRecord> stops;
+    std::vector<LineRecord> lines;
+    std::vector<StopInLineRecord> stops_in_lines;
+    std::string strings;
+    DepartureColumns departures;
+
+    // One REPEATABLE READ transaction (the departure COPY included), so a feed update landing
+    // in the middle of the load cannot pair new departures with old lines or stops
+    {
+        pqxx::transaction<pqxx::isolation_level::repeatable_read, pqxx::write_policy::read_only> txn(conn);
+        load_stop_rows(txn, "", stops, strings);
+        load_line_rows(txn, "", lines, strings);
+        load_stop_in_line_rows(txn, "", stops_in_lines);
+        departures = load_departures_binary(txn);
+        txn.commit();
+    }
+
+    return build_timetable(std::move(stops), std::move(lines), std::move(stops_in_lines), departures, strings);
+}
+
+Timetable load_timetable_changes(pqxx::connection &conn, const ChangeSet &changes) {
+    std::vector<StopRecord> stops;
+    std::vector<LineRecord> lines;
+    std::vector<StopInLineRecord> stops_in_lines;
+    std::string strings;
+    DepartureColumns departures;
+
+    {
+        pqxx::transaction<pqxx::isolation_level::repeatable_read, pqxx::write_policy::read_only> txn(conn);
+        if (!changes.stops.empty()) {
+            load_stop_rows(txn, " AND id IN (" + id_list(changes.stops) + ")", stops, strings);
+        }
+        if (!changes.lines.empty()) {
+            load_line_rows(txn, " AND id IN (" + id_list(changes.lines) + ")", lines, strings);
+            load_stop_in_line_rows(txn, " AND bus_line_id IN (" + id_list(changes.lines) + ")", stops_in_lines);
+            departures = load_departures_binary(txn, std::vector<int32_t>(changes.lines.begin(), changes.lines.end()));
+        }
+        txn.commit();
+    }
+
+    return build_timetable(std::move(stops), std::move(lines), std::move(stops_in_lines), departures, strings);
+}
+
+void write_timetable_file(const Timetable &timetable, const std::string &path) {
+    // Written under a temporary name and renamed, so readers never map a half-written file
+    std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Failed to open " + temporary_path + " for writing");
+        }
+        file.write(timetable.image, static_cast<std::streamsize>(timetable.image_size));
+        if (!file) {
+            throw std::runtime_error("Failed to write " + temporary_path);
+        }
+    }
+
+    if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Failed to rename " + temporary_path + " to " + path);
+    }
+}
+
+Timetable open_timetable_file(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open timetable file " + path);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("Failed to stat timetable file " + path);
+    }
+
+    size_t size = static_cast<size_t>(file_stat.st_size);
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to mmap timetable file " + path);
+    }
+
+    std::shared_ptr<const void> storage(mapping, [size](const void *address) {
+        munmap(const_cast<void *>(address), size);
+    });
+    return bind_timetable(static_cast<const char *>(mapping), size, storage);
+}
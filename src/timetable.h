@@ -0,0 +1,138 @@
+#ifndef TIMETABLE_H
+#define TIMETABLE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <set>
+#include <pqxx/pqxx>
+#include "database_queries.h"
+
+// The whole network in one flat binary image: stops, lines, stop sequences,
+// departures and a string pool for names. The image is built in memory from the
+// database or mapped read-only from a file, and in both cases the Timetable only
+// points into it, so opening a file needs no parsing and pages are shared between
+// every process that maps the same file. Integers are stored in host byte order.
+
+const char TIMETABLE_MAGIC[8] = {'J', 'D', 'T', 'T', 'B', 'L', '0', '1'};
+const uint32_t TIMETABLE_VERSION = 2;
+
+struct TimetableSection {
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct TimetableFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t image_size;
+    TimetableSection stops;
+    TimetableSection lines;
+    TimetableSection stops_in_lines;
+    TimetableSection departure_id;
+    TimetableSection departure_bus_line_id;
+    TimetableSection departure_bus_stop_id;
+    TimetableSection departure_ordinal_number;
+    TimetableSection departure_time;
+    TimetableSection departure_route_day;
+    TimetableSection strings;
+};
+
+// route_search_busstop, sorted by id
+struct StopRecord {
+    int32_t id;
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t padding;
+    double latitude;
+    double longitude;
+};
+
+// route_search_busline, sorted by id
+struct LineRecord {
+    int32_t id;
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t direction_offset;
+    uint32_t direction_length;
+};
+
+// route_search_busstopinbusline, sorted by (bus_line_id, ordinal_number)
+struct StopInLineRecord {
+    int32_t bus_line_id;
+    int32_t bus_stop_id;
+    int32_t ordinal_number;
+};
+
+// Read-only columns of route_search_busdeparture,
+// sorted by (bus_line_id, route_day, departure_ordinal_number, position of the stop in the line)
+struct DepartureView {
+    const int32_t *id = nullptr;
+    const int32_t *bus_line_id = nullptr;
+    const int32_t *bus_stop_id = nullptr;
+    const int32_t *departure_ordinal_number = nullptr;
+    const int32_t *time = nullptr;
+    const uint8_t *route_day = nullptr;
+    size_t count = 0;
+};
+
+struct Timetable {
+    const StopRecord *stops = nullptr;
+    size_t stop_count = 0;
+    const LineRecord *lines = nullptr;
+    size_t line_count = 0;
+    const StopInLineRecord *stops_in_lines = nullptr;
+    size_t stop_in_line_count = 0;
+    DepartureView departures;
+    const char *strings = nullptr;
+    size_t strings_size = 0;
+
+    // The raw image and whatever keeps it alive (a heap buffer or a file mapping)
+    const char *image = nullptr;
+    size_t image_size = 0;
+    std::shared_ptr<const void> storage;
+
+    std::string_view stop_name(size_t stop_index) const;
+    std::string_view line_name(size_t line_index) const;
+    std::string_view line_direction(size_t line_index) const;
+
+    // Index into stops/lines for a database id, or -1 if there is no such row
+    int find_stop(int32_t stop_id) const;
+    int find_line(int32_t line_id) const;
+};
+
+// Stops and lines touched by a change to the route_search_* tables.
+// full means the change could not be narrowed down and everything has to be reloaded.
+struct ChangeSet {
+    std::set<int32_t> lines;
+    std::set<int32_t> stops;
+    bool full = false;
+
+    bool empty() const { return !full && lines.empty() && stops.empty(); }
+    void merge(const ChangeSet &other);
+};
+
+// Function to pull the whole network from Postgres into a freshly built image, every table
+// read in one REPEATABLE READ transaction so the image is a consistent snapshot
+Timetable load_timetable(pqxx::connection &conn);
+
+// Builds an image from already loaded rows, sorting every section into its documented order.
+// Name offsets in stops and lines point into strings.
+Timetable build_timetable(std::vector<StopRecord> stops, std::vector<LineRecord> lines, std::vector<StopInLineRecord> stops_in_lines, const DepartureColumns &departures, const std::string &strings);
+
+// Image holding only the current rows of the changed stops and lines (with the stop
+// sequences and departures of those lines); stops and lines that no longer exist are absent.
+// Read in one REPEATABLE READ transaction, like load_timetable.
+Timetable load_timetable_changes(pqxx::connection &conn, const ChangeSet &changes);
+
+void write_timetable_file(const Timetable &timetable, const std::string &path);
+
+// Maps a file written by write_timetable_file; throws std::runtime_error if it is not a valid
+// image (bad header, a section or a name outside the file)
+Timetable open_timetable_file(const std::string &path);
+
+#endif // TIMETABLE_H
@@ -0,0 +1,52 @@
+#ifndef TOP_K_H
+#define TOP_K_H
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Keeps the k smallest of a stream of values in a bounded max-heap: O(log k) per
+// accepted value and O(1) per rejected one, with at most k values ever stored.
+// One selector per thread, merged at the end, needs no shared state while scanning.
+template <typename T, typename Less = std::less<T>>
+class TopK {
+public:
+    explicit TopK(size_t k, Less less = Less()) : k(k), less(less) {
+        heap.reserve(k);
+    }
+
+    void push(T value) {
+        if (heap.size() == k) {
+            if (k == 0 || !less(value, heap.front())) {
+                return;
+            }
+            std::pop_heap(heap.begin(), heap.end(), less);
+            heap.back() = std::move(value);
+        } else {
+            heap.push_back(std::move(value));
+        }
+        std::push_heap(heap.begin(), heap.end(), less);
+    }
+
+    void merge(TopK &&other) {
+        for (T &value : other.heap) {
+            push(std::move(value));
+        }
+        other.heap.clear();
+    }
+
+    // Function to take the kept values out, smallest first
+    std::vector<T> take_sorted() {
+        std::sort_heap(heap.begin(), heap.end(), less);
+        return std::move(heap);
+    }
+
+private:
+    size_t k;
+    Less less;
+    std::vector<T> heap;
+};
+
+#endif // TOP_K_H
@@ -0,0 +1,385 @@
+#include "transfer_patterns.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include "snapshot.h"
+#include "latency.h"
+
+std::vector<std::vector<int32_t>> TransferPatternGraph::sequences(int32_t target) const {
+    std::vector<std::vector<int32_t>> result;
+    auto it = std::lower_bound(target_stop_id.begin(), target_stop_id.end(), target);
+    if (it == target_stop_id.end() || *it != target) {
+        return result;
+    }
+
+    size_t index = it - target_stop_id.begin();
+    for (uint32_t i = target_first[index]; i < target_first[index + 1]; ++i) {
+        std::vector<int32_t> sequence = {target};
+        for (uint32_t node = target_nodes[i]; ; node = node_parent[node]) {
+            sequence.push_back(node_stop_id[node]);
+            if (node == 0) {
+                break;
+            }
+        }
+        std::reverse(sequence.begin(), sequence.end());
+        result.push_back(std::move(sequence));
+    }
+    return result;
+}
+
+const TransferPatternGraph *TransferPatterns::find(int32_t origin_stop_id) const {
+    auto it = std::lower_bound(graphs.begin(), graphs.end(), origin_stop_id, [](const TransferPatternGraph &graph, int32_t id) {
+        return graph.origin_stop_id < id;
+    });
+    return it != graphs.end() && it->origin_stop_id == origin_stop_id ? &*it : nullptr;
+}
+
+// Function to fold the change-stop sequences found for one origin into its DAG
+static TransferPatternGraph build_graph(int32_t origin_stop_id, const std::map<int32_t, std::set<std::vector<int32_t>>> &found) {
+    TransferPatternGraph graph;
+    graph.origin_stop_id = origin_stop_id;
+    graph.node_stop_id.push_back(origin_stop_id);
+    graph.node_parent.push_back(0);
+
+    std::map<std::pair<uint32_t, int32_t>, uint32_t> children;
+    graph.target_first.push_back(0);
+    for (const auto &entry : found) {
+        graph.target_stop_id.push_back(entry.first);
+        for (const std::vector<int32_t> &change_stops : entry.second) {
+            uint32_t node = 0;
+            for (int32_t stop_id : change_stops) {
+                auto child = children.find({node, stop_id});
+                if (child == children.end()) {
+                    child = children.emplace(std::make_pair(node, stop_id), static_cast<uint32_t>(graph.node_stop_id.size())).first;
+                    graph.node_stop_id.push_back(stop_id);
+                    graph.node_parent.push_back(node);
+                }
+                node = child->second;
+            }
+            graph.target_nodes.push_back(node);
+        }
+        graph.target_first.push_back(static_cast<uint32_t>(graph.target_nodes.size()));
+    }
+    return graph;
+}
+
+TransferPatterns build_transfer_patterns(const DayPartition &partition, const std::vector<int32_t> &origin_stop_ids, const RaptorOptions &options) {
+    TransferPatterns patterns;
+    patterns.day_type = partition.day_type;
+    patterns.timetable_fingerprint = partition.fingerprint;
+    patterns.max_legs = options.max_legs;
+    patterns.change_seconds = options.change_seconds;
+
+    std::vector<int32_t> origins = origin_stop_ids.empty() ? partition.stop_ids : origin_stop_ids;
+    std::sort(origins.begin(), origins.end());
+    origins.erase(std::unique(origins.begin(), origins.end()), origins.end());
+    origins.erase(std::remove_if(origins.begin(), origins.end(), [&](int32_t id) { return partition.stop_index(id) < 0; }), origins.end());
+    patterns.graphs.resize(origins.size());
+
+    RaptorOptions forwards = options;
+    forwards.arrive_by = false;
+
+    #pragma omp parallel
+    {
+        // One search and one label copy per thread, reset between origins
+        RaptorSearch search(partition, forwards);
+        std::vector<std::vector<int32_t>> recorded(options.max_legs + 1, std::vector<int32_t>(partition.stop_count()));
+
+        #pragma omp for schedule(dynamic)
+        for (size_t i = 0; i < origins.size(); ++i) {
+            int32_t origin = origins[i];
+            uint32_t origin_index = static_cast<uint32_t>(partition.stop_index(origin));
+            search.reset();
+            for (auto &round : recorded) {
+                std::fill(round.begin(), round.end(), RAPTOR_UNREACHED);
+            }
+
+            // Every departure from the origin, latest first, as in raptor_profile
+            std::vector<int32_t> departure_times;
+            for (const PatternStop &entry : partition.stop_patterns[origin_index]) {
+                const RoutePattern &pattern = *partition.patterns[entry.pattern];
+                if (entry.position + 1 < pattern.stop_count()) {
+                    departure_times.insert(departure_times.end(), pattern.column(entry.position), pattern.column(entry.position) + pattern.trip_count());
+                }
+            }
+            std::sort(departure_times.begin(), departure_times.end(), std::greater<int32_t>());
+            departure_times.erase(std::unique(departure_times.begin(), departure_times.end()), departure_times.end());
+
+            std::map<int32_t, std::set<std::vector<int32_t>>> found;
+            for (int32_t departure_time : departure_times) {
+                search.run({{origin, 0}}, departure_time);
+                for (uint32_t stop : search.improved_stops()) {
+                    if (stop == origin_index) {
+                        continue;
+                    }
+                    for (int legs = 1; legs <= options.max_legs; ++legs) {
+                        int32_t arrival = search.best_time(stop, legs);
+                        if (arrival < recorded[legs][stop] && arrival < search.best_time(stop, legs - 1)) {
+                            Journey journey = search.journey(stop, legs);
+                            std::vector<int32_t> change_stops;
+                            for (size_t leg = 0; leg + 1 < journey.legs.size(); ++leg) {
+                                change_stops.push_back(journey.legs[leg].to_stop_id);
+                            }
+                            found[partition.stop_ids[stop]].insert(change_stops);
+                        }
+                    }
+                    for (int legs = 0; legs <= options.max_legs; ++legs) {
+                        recorded[legs][stop] = search.best_time(stop, legs);
+                    }
+                }
+            }
+
+            patterns.graphs[i] = build_graph(origin, found);
+        }
+    }
+
+    return patterns;
+}
+
+template <typename T>
+static void write_value(std::ofstream &file, const T &value) {
+    file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+static void write_vector(std::ofstream &file, const std::vector<T> &values) {
+    write_value(file, static_cast<uint64_t>(values.size()));
+    file.write(reinterpret_cast<const char *>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
+
+template <typename T>
+static void read_value(std::ifstream &file, T &value) {
+    if (!file.read(reinterpret_cast<char *>(&value), sizeof(T))) {
+        throw std::runtime_error("Truncated transfer patterns file");
+    }
+}
+
+// Function to tell how many bytes of the file are left to read
+static uint64_t remaining_bytes(std::ifstream &file, uint64_t file_size) {
+    std::streamoff position = file.tellg();
+    if (position < 0 || static_cast<uint64_t>(position) > file_size) {
+        throw std::runtime_error("Truncated transfer patterns file");
+    }
+    return file_size - static_cast<uint64_t>(position);
+}
+
+template <typename T>
+static void read_vector(std::ifstream &file, uint64_t file_size, std::vector<T> &values) {
+    uint64_t count;
+    read_value(file, count);
+    // A corrupt count must not turn into a huge allocation before the read fails
+    if (count > remaining_bytes(file, file_size) / sizeof(T)) {
+        throw std::runtime_error("Truncated transfer patterns file");
+    }
+    values.resize(count);
+    if (!file.read(reinterpret_cast<char *>(values.data()), static_cast<std::streamsize>(count * sizeof(T)))) {
+        throw std::runtime_error("Truncated transfer patterns file");
+    }
+}
+
+void write_transfer_patterns(const TransferPatterns &patterns, const std::string &path) {
+    // Written under a temporary name and renamed, like write_timetable_file
+    std::string temporary_path = path + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw std::runtime_error("Failed to open " + temporary_path + " for writing");
+        }
+        file.write(TRANSFER_PATTERNS_MAGIC, sizeof(TRANSFER_PATTERNS_MAGIC));
+        write_value(file, static_cast<uint8_t>(patterns.day_type));
+        write_value(file, static_cast<int32_t>(patterns.max_legs));
+        write_value(file, patterns.change_seconds);
+        write_value(file, patterns.timetable_fingerprint);
+        write_value(file, static_cast<uint64_t>(patterns.graphs.size()));
+        for (const TransferPatternGraph &graph : patterns.graphs) {
+            write_value(file, graph.origin_stop_id);
+            write_vector(file, graph.node_stop_id);
+            write_vector(file, graph.node_parent);
+            write_vector(file, graph.target_stop_id);
+            write_vector(file, graph.target_first);
+            write_vector(file, graph.target_nodes);
+        }
+        if (!file) {
+            throw std::runtime_error("Failed to write " + temporary_path);
+        }
+    }
+
+    if (std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Failed to rename " + temporary_path + " to " + path);
+    }
+}
+
+TransferPatterns read_transfer_patterns(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open transfer patterns file " + path);
+    }
+    file.seekg(0, std::ios::end);
+    uint64_t file_size = static_cast<uint64_t>(file.tellg());
+    file.seekg(0, std::ios::beg);
+
+    char magic[sizeof(TRANSFER_PATTERNS_MAGIC)];
+    if (!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), TRANSFER_PATTERNS_MAGIC)) {
+        throw std::runtime_error("Not a transfer patterns file: " + path);
+    }
+
+    TransferPatterns patterns;
+    uint8_t day_type;
+    int32_t max_legs;
+    uint64_t graph_count;
+    read_value(file, day_type);
+    read_value(file, max_legs);
+    read_value(file, patterns.change_seconds);
+    read_value(file, patterns.timetable_fingerprint);
+    read_value(file, graph_count);
+    if (day_type >= DAY_TYPE_COUNT) {
+        throw std::runtime_error("Invalid day type in " + path);
+    }
+    patterns.day_type = static_cast<DayType>(day_type);
+    patterns.max_legs = max_legs;
+
+    // Every graph takes at least its origin and five vector counts
+    if (graph_count > remaining_bytes(file, file_size) / (sizeof(int32_t) + 5 * sizeof(uint64_t))) {
+        throw std::runtime_error("Malformed transfer patterns file " + path);
+    }
+    patterns.graphs.resize(graph_count);
+    for (TransferPatternGraph &graph : patterns.graphs) {
+        read_value(file, graph.origin_stop_id);
+        read_vector(file, file_size, graph.node_stop_id);
+        read_vector(file, file_size, graph.node_parent);
+        read_vector(file, file_size, graph.target_stop_id);
+        read_vector(file, file_size, graph.target_first);
+        read_vector(file, file_size, graph.target_nodes);
+        if (graph.node_stop_id.empty() || graph.node_parent.size() != graph.node_stop_id.size() ||
+            graph.target_first.size() != graph.target_stop_id.size() + 1 || graph.target_first.front() != 0 ||
+            graph.target_first.back() != graph.target_nodes.size()) {
+            throw std::runtime_error("Malformed transfer patterns file " + path);
+        }
+        // sequences() walks parent links up to node 0, so every parent must come before its child
+        if (graph.node_parent[0] != 0) {
+            throw std::runtime_error("Malformed transfer patterns file " + path);
+        }
+        for (size_t i = 1; i < graph.node_parent.size(); ++i) {
+            if (graph.node_parent[i] >= i) {
+                throw std::runtime_error("Malformed transfer patterns file " + path);
+            }
+        }
+        for (size_t i = 1; i < graph.target_first.size(); ++i) {
+            if (graph.target_first[i] < graph.target_first[i - 1]) {
+                throw std::runtime_error("Malformed transfer patterns file " + path);
+            }
+        }
+        for (uint32_t node : graph.target_nodes) {
+            if (node >= graph.node_stop_id.size()) {
+                throw std::runtime_error("Malformed transfer patterns file " + path);
+            }
+        }
+    }
+    return patterns;
+}
+
+// Function to find the earliest direct ride from one stop to another leaving at or after ready
+static bool earliest_ride(const DayPartition &partition, int32_t from_stop_id, int32_t to_stop_id, int32_t ready, JourneyLeg &leg) {
+    int from = partition.stop_index(from_stop_id);
+    if (from < 0) {
+        return false;
+    }
+
+    bool found = false;
+    for (const PatternStop &entry : partition.stop_patterns[from]) {
+        const RoutePattern &pattern = *partition.patterns[entry.pattern];
+        auto to = std::find(pattern.stop_ids.begin() + entry.position + 1, pattern.stop_ids.end(), to_stop_id);
+        if (to == pattern.stop_ids.end()) {
+            continue;
+        }
+        int trip = pattern.first_trip_after(entry.position, ready);
+        if (trip < 0) {
+            continue;
+        }
+        int32_t arrival = pattern.time(trip, to - pattern.stop_ids.begin());
+        if (!found || arrival < leg.arrival_time) {
+            leg = {pattern.line_id, pattern.trip_ordinals[trip], from_stop_id, to_stop_id, pattern.time(trip, entry.position), arrival};
+            found = true;
+        }
+    }
+    return found;
+}
+
+std::vector<Journey> transfer_pattern_query(const TransferPatterns &patterns, const DayPartition &partition, const std::vector<StopAccess> &origins, const std::vector<StopAccess> &goals, int32_t departure_time) {
+    // Patterns of another timetable would silently miss journeys, so they are refused
+    if (patterns.day_type != partition.day_type) {
+        throw std::runtime_error(std::string("Transfer patterns are for ") + day_type_name(patterns.day_type) +
+                                 ", not " + day_type_name(partition.day_type));
+    }
+    if (patterns.timetable_fingerprint != partition.fingerprint) {
+        throw std::runtime_error("Transfer patterns were built from another timetable; rebuild them");
+    }
+
+    // Best journey per number of legs; index 0 only bounds the others (an origin that is also a goal)
+    std::vector<Journey> best(patterns.max_legs + 1);
+    for (Journey &journey : best) {
+        journey.arrival_time = RAPTOR_UNREACHED;
+    }
+
+    for (const StopAccess &origin : origins) {
+        const TransferPatternGraph *graph = patterns.find(origin.stop_id);
+        if (!graph) {
+            continue;
+        }
+        for (const StopAccess &goal : goals) {
+            if (goal.stop_id == origin.stop_id) {
+                best[0].arrival_time = std::min(best[0].arrival_time, departure_time + origin.walk_seconds + goal.walk_seconds);
+                continue;
+            }
+            for (const std::vector<int32_t> &sequence : graph->sequences(goal.stop_id)) {
+                Journey journey;
+                int32_t ready = departure_time + origin.walk_seconds;
+                bool reachable = true;
+                for (size_t hop = 0; hop + 1 < sequence.size() && reachable; ++hop) {
+                    JourneyLeg leg;
+                    reachable = earliest_ride(partition, sequence[hop], sequence[hop + 1], ready + (hop > 0 ? patterns.change_seconds : 0), leg);
+                    if (reachable) {
+                        journey.legs.push_back(leg);
+                        ready = leg.arrival_time;
+                    }
+                }
+                size_t legs = journey.legs.size();
+                if (!reachable || legs == 0 || legs >= best.size()) {
+                    continue;
+                }
+                journey.departure_time = journey.legs.front().departure_time - origin.walk_seconds;
+                journey.arrival_time = ready + goal.walk_seconds;
+                if (journey.arrival_time < best[legs].arrival_time ||
+                    (journey.arrival_time == best[legs].arrival_time && journey.departure_time > best[legs].departure_time)) {
+                    best[legs] = journey;
+                }
+            }
+        }
+    }
+
+    // Same answer shape as raptor_earliest_arrival: more legs only when strictly faster
+    std::vector<Journey> journeys;
+    int32_t bound = best[0].arrival_time;
+    for (size_t legs = 1; legs < best.size(); ++legs) {
+        if (best[legs].arrival_time < bound) {
+            journeys.push_back(best[legs]);
+            bound = best[legs].arrival_time;
+        }
+    }
+    return journeys;
+}
+
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes_transfer_patterns(const TimetableSnapshot &snapshot, const TransferPatterns &patterns, Coordinates start_coords, Coordinates goal_coords, const std::string &date, const std::string &time) {
+    ScopedLatency timer(LatencyEndpoint::FindRoutesTransferPatterns);
+    const DayPartition &partition = snapshot.partition(day_type_for_date(date));
+    std::vector<StopAccess> origins = candidate_stop_access(snapshot, start_coords);
+    std::vector<StopAccess> goals = candidate_stop_access(snapshot, goal_coords);
+
+    std::vector<std::variant<Solution, SolutionTwoBuses>> solutions;
+    for (const Journey &journey : transfer_pattern_query(patterns, partition, origins, goals, parse_time_of_day(time))) {
+        solutions.push_back(journey_to_solution(snapshot, journey));
+    }
+    return solutions;
+}
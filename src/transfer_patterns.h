@@ -0,0 +1,62 @@
+#ifndef TRANSFER_PATTERNS_H
+#define TRANSFER_PATTERNS_H
+
+#include <cstdint>
+#include <string>
+#include <variant>
+#include <vector>
+#include "partition.h"
+#include "journey.h"
+#include "raptor.h"
+
+// Transfer patterns: for an origin stop, the sequences of stops (origin, change stops,
+// destination) used by at least one optimal journey at some time of day. They are found
+// offline by a profile search over the whole day from every origin, so an online query
+// only has to evaluate those few sequences against the timetable.
+
+const char TRANSFER_PATTERNS_MAGIC[8] = {'J', 'D', 'T', 'P', 'A', 'T', '0', '2'};
+
+// The patterns of one origin as a DAG. Node 0 is the origin and the other nodes are
+// change stops; every node points at the node before it, so sequences sharing a prefix
+// share nodes. A destination points at the last node of each of its sequences.
+struct TransferPatternGraph {
+    int32_t origin_stop_id = 0;
+    std::vector<int32_t> node_stop_id;
+    std::vector<uint32_t> node_parent;       // node 0 is its own parent
+    std::vector<int32_t> target_stop_id;     // sorted
+    std::vector<uint32_t> target_first;      // target_stop_id.size() + 1 offsets into target_nodes
+    std::vector<uint32_t> target_nodes;
+
+    // Stop sequences from the origin to a destination, or none if it was never reached
+    std::vector<std::vector<int32_t>> sequences(int32_t target_stop_id) const;
+};
+
+struct TransferPatterns {
+    DayType day_type = DayType::Working;
+    uint64_t timetable_fingerprint = 0; // DayPartition::fingerprint of the partition they were built from
+    int max_legs = 2;           // options the patterns were built with
+    int32_t change_seconds = 0;
+    std::vector<TransferPatternGraph> graphs; // sorted by origin_stop_id
+
+    const TransferPatternGraph *find(int32_t origin_stop_id) const;
+};
+
+// Function to precompute the patterns of the given origins (all stops of the partition when
+// empty), one profile search per origin spread over the OpenMP threads
+TransferPatterns build_transfer_patterns(const DayPartition &partition, const std::vector<int32_t> &origin_stop_ids = {}, const RaptorOptions &options = RaptorOptions());
+
+void write_transfer_patterns(const TransferPatterns &patterns, const std::string &path);
+
+// Reads a file written by write_transfer_patterns; throws std::runtime_error if it is not valid
+TransferPatterns read_transfer_patterns(const std::string &path);
+
+// Function to answer an earliest-arrival query by evaluating only the precomputed sequences,
+// one direct ride per hop. Arrival times match raptor_earliest_arrival with the options the
+// patterns were built with; origins without patterns are skipped. Throws std::runtime_error
+// if the partition is not the one (same day type and fingerprint) the patterns were built from.
+std::vector<Journey> transfer_pattern_query(const TransferPatterns &patterns, const DayPartition &partition, const std::vector<StopAccess> &origins, const std::vector<StopAccess> &goals, int32_t departure_time);
+
+// Function to run a transfer-pattern query between two geocoded locations over a snapshot, with the time as HH:MM
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes_transfer_patterns(const TimetableSnapshot &snapshot, const TransferPatterns &patterns, Coordinates start_coords, Coordinates goal_coords, const std::string &date, const std::string &time);
+
+#endif // TRANSFER_PATTERNS_H
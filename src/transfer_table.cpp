@@ -0,0 +1,169 @@
+#include "transfer_table.h"
+#include <algorithm>
+#include <utility>
+#include "snapshot.h"
+
+ConstRange<TransferPoint> TransferTable::transfers(int32_t from_line, int32_t to_line) const {
+    auto it = std::lower_bound(pairs.begin(), pairs.end(), std::make_pair(from_line, to_line),
+                               [](const LinePairTransfers &pair, const std::pair<int32_t, int32_t> &key) {
+                                   return std::make_pair(pair.from_line, pair.to_line) < key;
+                               });
+    if (it == pairs.end() || it->from_line != from_line || it->to_line != to_line) {
+        return {};
+    }
+    return {points.data() + it->first, points.data() + it->first + it->count};
+}
+
+ConstRange<LinePairTransfers> TransferTable::pairs_from(int32_t from_line) const {
+    auto first = std::lower_bound(pairs.begin(), pairs.end(), from_line,
+                                  [](const LinePairTransfers &pair, int32_t line) { return pair.from_line < line; });
+    auto last = std::upper_bound(first, pairs.end(), from_line,
+                                 [](int32_t line, const LinePairTransfers &pair) { return line < pair.from_line; });
+    return {pairs.data() + (first - pairs.begin()), pairs.data() + (last - pairs.begin())};
+}
+
+std::shared_ptr<const TransferTable> build_transfer_table(const std::map<int32_t, std::shared_ptr<const LineTimetable>> &lines) {
+    std::vector<const LineTimetable *> line_list;
+    for (const auto &entry : lines) {
+        line_list.push_back(entry.second.get());
+    }
+
+    // stop id -> (line index, ordinal) of every stop that is not the last one of its line
+    std::map<int32_t, std::vector<std::pair<size_t, int32_t>>> boardings;
+    for (size_t l = 0; l < line_list.size(); ++l) {
+        const LineTimetable &line = *line_list[l];
+        for (size_t i = 0; i + 1 < line.stop_count; ++i) {
+            boardings[line.stops[i].bus_stop_id].push_back({l, line.stops[i].ordinal_number});
+        }
+    }
+
+    // Lines are independent, so every line collects the transfers leaving it in parallel
+    std::vector<std::vector<std::pair<int32_t, TransferPoint>>> per_line(line_list.size());
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t l = 0; l < line_list.size(); ++l) {
+        const LineTimetable &line = *line_list[l];
+        for (size_t i = 1; i < line.stop_count; ++i) {
+            auto it = boardings.find(line.stops[i].bus_stop_id);
+            if (it == boardings.end()) {
+                continue;
+            }
+            for (const auto &boarding : it->second) {
+                const LineTimetable &other = *line_list[boarding.first];
+                if (other.name == line.name) {
+                    continue;
+                }
+                per_line[l].push_back({other.id, {line.stops[i].bus_stop_id, line.stops[i].ordinal_number, boarding.second}});
+            }
+        }
+        std::stable_sort(per_line[l].begin(), per_line[l].end(), [](const auto &a, const auto &b) {
+            return a.first < b.first;
+        });
+    }
+
+    auto table = std::make_shared<TransferTable>();
+    for (size_t l = 0; l < line_list.size(); ++l) {
+        for (const auto &entry : per_line[l]) {
+            if (table->pairs.empty() || table->pairs.back().from_line != line_list[l]->id || table->pairs.back().to_line != entry.first) {
+                table->pairs.push_back({line_list[l]->id, entry.first, static_cast<uint32_t>(table->points.size()), 0});
+            }
+            table->points.push_back(entry.second);
+            ++table->pairs.back().count;
+        }
+    }
+    return table;
+}
+
+std::shared_ptr<const TransferTable> patch_transfer_table(const TransferTable &base, const std::map<int32_t, std::shared_ptr<const LineTimetable>> &lines,
+                                                          const std::map<int32_t, std::shared_ptr<const std::vector<int32_t>>> &stop_lines,
+                                                          const std::set<int32_t> &changed_lines) {
+    // (from_line, to_line) -> points; recomputed pairs of the changed lines
+    std::map<std::pair<int32_t, int32_t>, std::vector<TransferPoint>> fresh;
+    auto lines_at = [&](int32_t stop_id) -> const std::vector<int32_t> * {
+        auto it = stop_lines.find(stop_id);
+        return it == stop_lines.end() ? nullptr : it->second.get();
+    };
+
+    for (int32_t line_id : changed_lines) {
+        auto found = lines.find(line_id);
+        if (found == lines.end()) {
+            continue; // deleted, its pairs just go away
+        }
+        const LineTimetable &line = *found->second;
+
+        // Leaving the changed line, in the order build_transfer_table emits them
+        for (size_t i = 1; i < line.stop_count; ++i) {
+            const std::vector<int32_t> *serving = lines_at(line.stops[i].bus_stop_id);
+            if (serving == nullptr) {
+                continue;
+            }
+            for (int32_t other_id : *serving) {
+                const LineTimetable &other = *lines.at(other_id);
+                if (other.name == line.name) {
+                    continue;
+                }
+                for (size_t j = 0; j + 1 < other.stop_count; ++j) {
+                    if (other.stops[j].bus_stop_id == line.stops[i].bus_stop_id) {
+                        fresh[{line.id, other.id}].push_back({line.stops[i].bus_stop_id, line.stops[i].ordinal_number, other.stops[j].ordinal_number});
+                    }
+                }
+            }
+        }
+
+        // Boarding the changed line from an unchanged one (changed ones are covered above)
+        std::map<int32_t, std::vector<std::pair<size_t, TransferPoint>>> incoming; // from_line -> (position on it, point)
+        for (size_t j = 0; j + 1 < line.stop_count; ++j) {
+            const std::vector<int32_t> *serving = lines_at(line.stops[j].bus_stop_id);
+            if (serving == nullptr) {
+                continue;
+            }
+            for (int32_t other_id : *serving) {
+                if (changed_lines.count(other_id) != 0) {
+                    continue;
+                }
+                const LineTimetable &other = *lines.at(other_id);
+                if (other.name == line.name) {
+                    continue;
+                }
+                for (size_t i = 1; i < other.stop_count; ++i) {
+                    if (other.stops[i].bus_stop_id == line.stops[j].bus_stop_id) {
+                        incoming[other.id].push_back({i, {line.stops[j].bus_stop_id, other.stops[i].ordinal_number, line.stops[j].ordinal_number}});
+                    }
+                }
+            }
+        }
+        for (auto &entry : incoming) {
+            // Points of a pair follow the first line's stop order
+            std::stable_sort(entry.second.begin(), entry.second.end(), [](const auto &a, const auto &b) {
+                return a.first < b.first;
+            });
+            std::vector<TransferPoint> &points = fresh[{entry.first, line.id}];
+            for (const auto &point : entry.second) {
+                points.push_back(point.second);
+            }
+        }
+    }
+
+    // Merge the untouched pairs of base with the fresh ones, both sorted by (from_line, to_line)
+    auto table = std::make_shared<TransferTable>();
+    table->pairs.reserve(base.pairs.size());
+    table->points.reserve(base.points.size());
+    auto emit = [&](int32_t from_line, int32_t to_line, const TransferPoint *first, const TransferPoint *last) {
+        table->pairs.push_back({from_line, to_line, static_cast<uint32_t>(table->points.size()), static_cast<uint32_t>(last - first)});
+        table->points.insert(table->points.end(), first, last);
+    };
+
+    auto next = fresh.begin();
+    for (const LinePairTransfers &pair : base.pairs) {
+        if (changed_lines.count(pair.from_line) != 0 || changed_lines.count(pair.to_line) != 0) {
+            continue;
+        }
+        for (; next != fresh.end() && next->first < std::make_pair(pair.from_line, pair.to_line); ++next) {
+            emit(next->first.first, next->first.second, next->second.data(), next->second.data() + next->second.size());
+        }
+        emit(pair.from_line, pair.to_line, base.points.data() + pair.first, base.points.data() + pair.first + pair.count);
+    }
+    for (; next != fresh.end(); ++next) {
+        emit(next->first.first, next->first.second, next->second.data(), next->second.data() + next->second.size());
+    }
+    return table;
+}
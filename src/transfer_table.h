@@ -0,0 +1,64 @@
+#ifndef TRANSFER_TABLE_H
+#define TRANSFER_TABLE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+struct LineTimetable;
+
+// A stop where a rider can leave one line and board another. Each route_search_busline
+// row is one direction of a line, so a line id already stands for (line, direction).
+struct TransferPoint {
+    int32_t stop_id;
+    int32_t from_ordinal; // ordinal_number of the stop on the first line
+    int32_t to_ordinal;   // ordinal_number of the stop on the second line
+};
+
+// All transfer points of one ordered line pair, as a range in TransferTable::points
+struct LinePairTransfers {
+    int32_t from_line;
+    int32_t to_line;
+    uint32_t first;
+    uint32_t count;
+};
+
+template <typename T>
+struct ConstRange {
+    const T *first = nullptr;
+    const T *last = nullptr;
+
+    const T *begin() const { return first; }
+    const T *end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+    bool empty() const { return first == last; }
+};
+
+// Every (line A, line B) pair with at least one stop where A can be left (it is not A's
+// first stop) and B boarded (it is not B's last stop), with those stops in A's order.
+// Pairs of lines sharing a name (the two directions of one line) are left out, as the
+// routers never change to the same line.
+struct TransferTable {
+    std::vector<LinePairTransfers> pairs; // sorted by (from_line, to_line)
+    std::vector<TransferPoint> points;    // grouped by pair, by from_ordinal within a pair
+
+    ConstRange<TransferPoint> transfers(int32_t from_line, int32_t to_line) const;
+    // Lines reachable from from_line with one change
+    ConstRange<LinePairTransfers> pairs_from(int32_t from_line) const;
+};
+
+// Function to build the table from the stop sequences of every line
+std::shared_ptr<const TransferTable> build_transfer_table(const std::map<int32_t, std::shared_ptr<const LineTimetable>> &lines);
+
+// Function to update a table after the given lines changed (or were deleted): pairs that
+// involve none of them are copied from base, only pairs from or to a changed line are
+// recomputed, looking up the lines at each of its stops in stop_lines. Gives the same
+// table as build_transfer_table over the new lines.
+std::shared_ptr<const TransferTable> patch_transfer_table(const TransferTable &base, const std::map<int32_t, std::shared_ptr<const LineTimetable>> &lines,
+                                                          const std::map<int32_t, std::shared_ptr<const std::vector<int32_t>>> &stop_lines,
+                                                          const std::set<int32_t> &changed_lines);
+
+#endif // TRANSFER_TABLE_H
@@ -0,0 +1,65 @@
+// Computes a stop x stop earliest-arrival matrix for one date and departure time from a
+// timetable file written by build_timetable, using every core.
+//
+// Usage:
+//     travel_time_matrix <timetable file> <output file> <YYYY-MM-DD> <HH:MM> [--stops ID,ID,...]
+//                        [--max-legs N]
+//
+// Without --stops the matrix covers every stop served on that day. Journeys take at most
+// --max-legs rides (default 4, so three changes); pairs that need more stay unreachable.
+// The limit is recorded in the output file.
+#include <iostream>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "timetable.h"
+#include "snapshot.h"
+#include "calendar.h"
+#include "matrix.h"
+
+int main(int argc, char **argv) {
+    if (argc < 5 || argc % 2 != 1) {
+        std::cerr << "Usage: travel_time_matrix <timetable file> <output file> <YYYY-MM-DD> <HH:MM> [--stops ID,ID,...] [--max-legs N]" << std::endl;
+        return 1;
+    }
+
+    try {
+        std::vector<int32_t> stop_ids;
+        RaptorOptions options;
+        options.max_legs = MATRIX_DEFAULT_MAX_LEGS;
+        for (int i = 5; i < argc; i += 2) {
+            std::string arg = argv[i];
+            std::string value = argv[i + 1];
+            if (arg == "--stops") {
+                std::istringstream ss(value);
+                std::string id;
+                while (std::getline(ss, id, ',')) {
+                    stop_ids.push_back(std::stoi(id));
+                }
+            } else if (arg == "--max-legs") {
+                options.max_legs = std::stoi(value);
+                if (options.max_legs < 1) {
+                    throw std::runtime_error("--max-legs must be at least 1");
+                }
+            } else {
+                throw std::runtime_error("Unknown option " + arg);
+            }
+        }
+
+        auto start_time = std::chrono::steady_clock::now();
+        std::shared_ptr<const TimetableSnapshot> snapshot = make_snapshot(open_timetable_file(argv[1]), 1);
+        const DayPartition &partition = snapshot->partition(day_type_for_date(argv[3]));
+        TravelTimeMatrix matrix = compute_travel_time_matrix(partition, stop_ids, stop_ids, parse_time_of_day(argv[4]), options);
+        write_travel_time_matrix(matrix, argv[2]);
+
+        std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start_time;
+        std::cout << "Matrix: " << matrix.source_stop_ids.size() << " x " << matrix.target_stop_ids.size()
+                  << " (at most " << matrix.max_legs << " legs), written to " << argv[2] << " in " << elapsed_time.count() << " seconds" << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,265 @@
+#include "trip_based.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include "snapshot.h"
+#include "calendar.h"
+#include "latency.h"
+
+static const int32_t UNREACHED = std::numeric_limits<int32_t>::max();
+
+std::shared_ptr<const TripBasedIndex> build_trip_based_index(std::shared_ptr<const DayPartition> partition, int32_t change_seconds) {
+    auto index = std::make_shared<TripBasedIndex>();
+    index->partition = partition;
+    index->change_seconds = change_seconds;
+
+    const DayPartition &day = *partition;
+    index->trip_first.push_back(0);
+    index->event_first.push_back(0);
+    for (size_t p = 0; p < day.patterns.size(); ++p) {
+        const RoutePattern &pattern = *day.patterns[p];
+        for (size_t trip = 0; trip < pattern.trip_count(); ++trip) {
+            index->trip_pattern.push_back(static_cast<uint32_t>(p));
+            index->event_first.push_back(index->event_first.back() + static_cast<uint32_t>(pattern.stop_count()));
+        }
+        index->trip_first.push_back(static_cast<uint32_t>(index->trip_pattern.size()));
+    }
+
+    // Trips are independent, so each one collects its own transfers in parallel
+    std::vector<std::vector<std::pair<uint32_t, TripTransfer>>> per_trip(index->trip_count());
+    #pragma omp parallel
+    {
+        std::vector<int32_t> earliest(day.stop_count(), UNREACHED);
+        std::vector<uint32_t> touched;
+
+        #pragma omp for schedule(dynamic, 64)
+        for (size_t t = 0; t < index->trip_count(); ++t) {
+            uint32_t pattern_index = index->trip_pattern[t];
+            const RoutePattern &pattern = *day.patterns[pattern_index];
+            const std::vector<uint32_t> &stops = day.pattern_stops[pattern_index];
+            uint32_t trip = static_cast<uint32_t>(t) - index->trip_first[pattern_index];
+
+            auto improve = [&](uint32_t stop, int32_t arrival) {
+                if (arrival < earliest[stop]) {
+                    if (earliest[stop] == UNREACHED) {
+                        touched.push_back(stop);
+                    }
+                    earliest[stop] = arrival;
+                    return true;
+                }
+                return false;
+            };
+
+            // From the last stop back: a change at position i only stays if it improves on
+            // staying seated and on every change kept at a later position of this trip
+            for (size_t i = stops.size() - 1; i >= 1; --i) {
+                int32_t arrival = pattern.time(trip, i);
+                improve(stops[i], arrival);
+
+                for (const PatternStop &entry : day.stop_patterns[stops[i]]) {
+                    const RoutePattern &other = *day.patterns[entry.pattern];
+                    if (entry.position + 1 == other.stop_count()) {
+                        continue;
+                    }
+                    int other_trip = other.first_trip_after(entry.position, arrival + change_seconds);
+                    if (other_trip < 0) {
+                        continue;
+                    }
+                    // Changing to the same pattern only helps onto an earlier trip at an earlier stop
+                    if (entry.pattern == pattern_index && (static_cast<uint32_t>(other_trip) >= trip || entry.position >= i)) {
+                        continue;
+                    }
+
+                    bool useful = false;
+                    const std::vector<uint32_t> &other_stops = day.pattern_stops[entry.pattern];
+                    for (size_t k = entry.position + 1; k < other_stops.size(); ++k) {
+                        useful |= improve(other_stops[k], other.time(other_trip, k));
+                    }
+                    if (useful) {
+                        per_trip[t].push_back({static_cast<uint32_t>(i), {index->trip_first[entry.pattern] + other_trip, entry.position}});
+                    }
+                }
+            }
+
+            for (uint32_t stop : touched) {
+                earliest[stop] = UNREACHED;
+            }
+            touched.clear();
+            std::stable_sort(per_trip[t].begin(), per_trip[t].end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+        }
+    }
+
+    size_t event_count = index->event_first.back();
+    index->transfer_first.assign(event_count + 1, 0);
+    for (size_t t = 0; t < index->trip_count(); ++t) {
+        for (const auto &entry : per_trip[t]) {
+            ++index->transfer_first[index->event_first[t] + entry.first + 1];
+        }
+    }
+    for (size_t e = 0; e < event_count; ++e) {
+        index->transfer_first[e + 1] += index->transfer_first[e];
+    }
+    index->transfers.resize(index->transfer_first.back());
+    for (size_t t = 0; t < index->trip_count(); ++t) {
+        // Entries of one trip are sorted by position, so they fill their events in order
+        uint32_t next = index->transfer_first[index->event_first[t]];
+        for (const auto &entry : per_trip[t]) {
+            index->transfers[next++] = entry.second;
+        }
+    }
+    return index;
+}
+
+// A part of a trip being ridden: board at position from, useful up to (not including) position to
+struct TripSegment {
+    uint32_t trip;
+    uint32_t from;
+    uint32_t to;
+    int32_t parent;       // segment this one was changed to from, -1 when boarded at an origin
+    uint32_t parent_exit; // position the parent segment was left at
+    int32_t walk;         // walk to the origin stop, for first segments
+};
+
+// Where a goal stop can be reached by staying on a pattern
+struct GoalEntry {
+    uint32_t position;
+    int32_t walk;
+};
+
+std::vector<Journey> trip_based_earliest_arrival(const TripBasedIndex &index, const std::vector<StopAccess> &origins, const std::vector<StopAccess> &goals, int32_t departure_time, int max_legs) {
+    const DayPartition &day = *index.partition;
+
+    // pattern -> positions where it reaches a goal stop
+    std::vector<std::vector<GoalEntry>> goal_entries(day.patterns.size());
+    int32_t direct_bound = UNREACHED; // an origin that is also a goal
+    for (const StopAccess &goal : goals) {
+        int stop = day.stop_index(goal.stop_id);
+        if (stop < 0) {
+            continue;
+        }
+        for (const PatternStop &entry : day.stop_patterns[stop]) {
+            if (entry.position > 0) {
+                goal_entries[entry.pattern].push_back({entry.position, goal.walk_seconds});
+            }
+        }
+        for (const StopAccess &origin : origins) {
+            if (origin.stop_id == goal.stop_id) {
+                direct_bound = std::min(direct_bound, departure_time + origin.walk_seconds + goal.walk_seconds);
+            }
+        }
+    }
+
+    // First position reached on every trip; reaching a trip also reaches every later trip of its pattern
+    std::vector<uint32_t> reached(index.trip_count(), std::numeric_limits<uint32_t>::max());
+    std::vector<TripSegment> segments;
+    auto enqueue = [&](uint32_t trip, uint32_t position, int32_t parent, uint32_t parent_exit, int32_t walk) {
+        if (position >= reached[trip]) {
+            return;
+        }
+        uint32_t pattern_index = index.trip_pattern[trip];
+        uint32_t end = std::min(reached[trip], static_cast<uint32_t>(day.patterns[pattern_index]->stop_count()));
+        segments.push_back({trip, position, end, parent, parent_exit, walk});
+        for (uint32_t later = trip; later < index.trip_first[pattern_index + 1] && reached[later] > position; ++later) {
+            reached[later] = position;
+        }
+    };
+
+    for (const StopAccess &origin : origins) {
+        int stop = day.stop_index(origin.stop_id);
+        if (stop < 0) {
+            continue;
+        }
+        for (const PatternStop &entry : day.stop_patterns[stop]) {
+            const RoutePattern &pattern = *day.patterns[entry.pattern];
+            if (entry.position + 1 == pattern.stop_count()) {
+                continue;
+            }
+            int trip = pattern.first_trip_after(entry.position, departure_time + origin.walk_seconds);
+            if (trip >= 0) {
+                enqueue(index.trip_first[entry.pattern] + trip, entry.position, -1, 0, origin.walk_seconds);
+            }
+        }
+    }
+
+    // Best arrival per number of legs, with the segment and exit position that give it
+    std::vector<int32_t> best(max_legs + 1, UNREACHED);
+    std::vector<std::pair<int32_t, uint32_t>> best_exit(max_legs + 1, {-1, 0});
+    int32_t bound = direct_bound;
+
+    size_t level_begin = 0;
+    for (int legs = 1; legs <= max_legs && level_begin < segments.size(); ++legs) {
+        size_t level_end = segments.size();
+        for (size_t s = level_begin; s < level_end; ++s) {
+            TripSegment segment = segments[s];
+            uint32_t pattern_index = index.trip_pattern[segment.trip];
+
+            for (const GoalEntry &goal : goal_entries[pattern_index]) {
+                if (goal.position > segment.from && goal.position < segment.to) {
+                    int32_t arrival = index.time(segment.trip, goal.position) + goal.walk;
+                    if (arrival < bound) {
+                        bound = arrival;
+                        best[legs] = arrival;
+                        best_exit[legs] = {static_cast<int32_t>(s), goal.position};
+                    }
+                }
+            }
+
+            if (legs == max_legs) {
+                continue;
+            }
+            for (uint32_t position = segment.from + 1; position < segment.to; ++position) {
+                // Nothing after this point can beat the best arrival found so far
+                if (index.time(segment.trip, position) >= bound) {
+                    break;
+                }
+                uint32_t event = index.event_first[segment.trip] + position;
+                for (uint32_t i = index.transfer_first[event]; i < index.transfer_first[event + 1]; ++i) {
+                    const TripTransfer &transfer = index.transfers[i];
+                    enqueue(transfer.to_trip, transfer.to_position, static_cast<int32_t>(s), position, 0);
+                }
+            }
+        }
+        level_begin = level_end;
+    }
+
+    std::vector<Journey> journeys;
+    for (int legs = 1; legs <= max_legs; ++legs) {
+        if (best[legs] == UNREACHED) {
+            continue;
+        }
+        Journey journey;
+        journey.arrival_time = best[legs];
+        int32_t s = best_exit[legs].first;
+        uint32_t exit = best_exit[legs].second;
+        int32_t walk = 0;
+        while (s >= 0) {
+            const TripSegment &segment = segments[s];
+            const RoutePattern &pattern = index.pattern(segment.trip);
+            uint32_t trip = index.trip_index(segment.trip);
+            journey.legs.push_back({pattern.line_id, pattern.trip_ordinals[trip], pattern.stop_ids[segment.from], pattern.stop_ids[exit],
+                                    pattern.time(trip, segment.from), pattern.time(trip, exit)});
+            walk = segment.walk;
+            exit = segment.parent_exit;
+            s = segment.parent;
+        }
+        std::reverse(journey.legs.begin(), journey.legs.end());
+        journey.departure_time = journey.legs.front().departure_time - walk;
+        journeys.push_back(journey);
+    }
+    return journeys;
+}
+
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes_trip_based(const TimetableSnapshot &snapshot, const TripBasedIndex &index, Coordinates start_coords, Coordinates goal_coords, const std::string &date, const std::string &time) {
+    ScopedLatency timer(LatencyEndpoint::FindRoutesTripBased);
+    if (index.partition != snapshot.partitions[static_cast<int>(day_type_for_date(date))]) {
+        throw std::runtime_error("Trip-based index was not built for this snapshot and the day type of " + date);
+    }
+    std::vector<StopAccess> origins = candidate_stop_access(snapshot, start_coords);
+    std::vector<StopAccess> goals = candidate_stop_access(snapshot, goal_coords);
+
+    std::vector<std::variant<Solution, SolutionTwoBuses>> solutions;
+    for (const Journey &journey : trip_based_earliest_arrival(index, origins, goals, parse_time_of_day(time))) {
+        solutions.push_back(journey_to_solution(snapshot, journey));
+    }
+    return solutions;
+}
@@ -0,0 +1,51 @@
+#ifndef TRIP_BASED_H
+#define TRIP_BASED_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "partition.h"
+#include "journey.h"
+
+// Trip-based public transit routing over one day partition. A trip is one run of a route
+// pattern (the departures sharing a departure_ordinal_number); a stop event is a trip at
+// one position of its pattern. Preprocessing stores, for every stop event, the trips a
+// rider can change to there, keeping only those that get them somewhere earlier than
+// staying seated or changing later on the same trip would. A query is then a breadth-first
+// search over trip segments where level n means n + 1 rides, with no stop labels at all.
+
+// A change from a stop event to another trip at the same stop
+struct TripTransfer {
+    uint32_t to_trip;     // global trip index
+    uint32_t to_position; // position along the new trip's pattern
+};
+
+struct TripBasedIndex {
+    std::shared_ptr<const DayPartition> partition;
+    int32_t change_seconds = 0;
+    std::vector<uint32_t> trip_first;     // per pattern, global index of its first trip (patterns.size() + 1 entries)
+    std::vector<uint32_t> trip_pattern;   // per global trip, its pattern
+    std::vector<uint32_t> event_first;    // per global trip, index of its first stop event (trips + 1 entries)
+    std::vector<uint32_t> transfer_first; // per stop event, range in transfers (events + 1 entries)
+    std::vector<TripTransfer> transfers;
+
+    size_t trip_count() const { return trip_pattern.size(); }
+    uint32_t trip_index(uint32_t trip) const { return trip - trip_first[trip_pattern[trip]]; }
+    const RoutePattern &pattern(uint32_t trip) const { return *partition->patterns[trip_pattern[trip]]; }
+    int32_t time(uint32_t trip, uint32_t position) const { return pattern(trip).time(trip_index(trip), position); }
+};
+
+// Function to precompute the trip transfers of a partition, one trip per OpenMP iteration
+std::shared_ptr<const TripBasedIndex> build_trip_based_index(std::shared_ptr<const DayPartition> partition, int32_t change_seconds = 0);
+
+// Function to find the fastest journeys leaving at or after departure_time with at most
+// max_legs rides: one per number of legs, each arriving strictly earlier than every journey
+// with fewer legs, like raptor_earliest_arrival
+std::vector<Journey> trip_based_earliest_arrival(const TripBasedIndex &index, const std::vector<StopAccess> &origins, const std::vector<StopAccess> &goals, int32_t departure_time, int max_legs = 2);
+
+// Function to run an earliest-arrival query between two geocoded locations with an index
+// built from snapshot.partitions of the date's day type, with the time as HH:MM
+std::vector<std::variant<Solution, SolutionTwoBuses>> find_routes_trip_based(const TimetableSnapshot &snapshot, const TripBasedIndex &index, Coordinates start_coords, Coordinates goal_coords, const std::string &date, const std::string &time);
+
+#endif // TRIP_BASED_H